@@ -3,7 +3,11 @@
 #define __TEMPLATESINGLETON_H__
 
 #include <stdlib.h>
+#include <atomic>
+#include <mutex>
 
+// process wide instance, created on first get().
+// get() is one acquire load once the instance exists; creation is double checked under a mutex
 template<class T>
 class Singleton
 {
@@ -14,36 +18,79 @@ protected:
 	}
 	~Singleton()
 	{
-		
+
 	}
 
 public:
 	static T * get()
 	{
-		if (instance == nullptr) {
-			instance = new T;
-			atexit(destroy);
-		}
-
-		return instance;
+		T* p = instance.load(std::memory_order_acquire);
+		if (p == nullptr)
+			p = create();
+		return p;
 	};
 
+	// called at exit. get() after destroy() creates a new instance
 	static void destroy()
 	{
-		if (instance != nullptr)
-		{
-			delete instance;
-			instance = nullptr;
-		}
+		std::lock_guard<std::mutex> lock(mutex());
+		T* p = instance.exchange(nullptr, std::memory_order_acq_rel);
+		if (p != nullptr)
+			delete p;
 	};
 
 	Singleton(const Singleton&) = delete;
 	Singleton& operator= (const Singleton) = delete;
 
 private:
-	static T* instance;
+	static T* create()
+	{
+		std::lock_guard<std::mutex> lock(mutex());
+		T* p = instance.load(std::memory_order_relaxed);
+		if (p == nullptr) {
+			p = new T;
+			instance.store(p, std::memory_order_release);
+			static bool registered = (atexit(destroy), true);
+			(void)registered;
+		}
+		return p;
+	}
+
+	static std::mutex& mutex()
+	{
+		static std::mutex m;
+		return m;
+	}
+
+	static std::atomic<T*> instance;
 };
 
-template<class T> T* Singleton<T>::instance = nullptr;
+template<class T> std::atomic<T*> Singleton<T>::instance{ nullptr };
+
+// one instance per thread, created on first get() in that thread and destroyed at thread exit.
+// get() touches no atomics; cache the pointer in hot loops to skip the thread_local lookup too
+template<class T>
+class ThreadLocalSingleton
+{
+protected:
+	ThreadLocalSingleton()
+	{
+
+	}
+	~ThreadLocalSingleton()
+	{
+
+	}
+
+public:
+	static T * get()
+	{
+		static thread_local T instance;
+		return &instance;
+	};
+
+	ThreadLocalSingleton(const ThreadLocalSingleton&) = delete;
+	ThreadLocalSingleton& operator= (const ThreadLocalSingleton) = delete;
+};
 
-#endif // !__TEMPLATESINGLETON_H__
\ No newline at end of file
+#endif // !__TEMPLATESINGLETON_H__
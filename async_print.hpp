@@ -0,0 +1,553 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __ASYNC_PRINT_HPP__
+#define __ASYNC_PRINT_HPP__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef PRINT_ASYNC_RING_SIZE
+#define PRINT_ASYNC_RING_SIZE		(1 << 16)	// bytes per logging thread, power of 2
+#endif
+#ifndef PRINT_ASYNC_POLL_US
+#define PRINT_ASYNC_POLL_US			1000		// backend sleep when every ring is empty
+#endif
+#ifndef PRINT_BINARY
+#define PRINT_BINARY				0			// 1 : write the binary format read by print_decoder
+#endif
+
+#if PRINT_BINARY
+#include <map>
+#include "serializer_deserializer.hpp"
+#endif
+
+//--------------------------------------------------------------------------------------------------
+// Asynchronous backend for eprint / wprint / iprint / dprint (print_utils.hpp, PRINT_ASYNC 1)
+//	log(fmt, func, args...) copies the format pointer, func pointer and the raw arguments into a
+//	per thread single producer ring (no lock, no formatting, one release store).
+//	a background thread formats the records with snprintf and writes them in batches.
+//	fmt and func must have static storage (string literals, __FUNCTION__). const char* arguments
+//	are copied, other arguments must be trivially copyable (what printf takes anyway).
+//	order is kept per thread; lines of different threads are interleaved per batch, not by time.
+//	at exit the rings are drained and later calls print synchronously
+//
+// PRINT_BINARY 1 : the backend writes records instead of text, print_decoder turns them back into text.
+//	each call site (fmt, func, argument types) gets an id and its strings are written once, the first time
+//	it is seen in the file. a record is then its id, a timestamp and the arguments encoded with SerDes.
+//	file layout, little endian, strings as SerDes c strings (uint32_t length + characters) :
+//		"PRTBIN01"
+//		uint8_t binary_tag_format, uint32_t id, func, fmt, types	(before the first record of id)
+//		uint8_t binary_tag_record, uint32_t id, uint64_t time, arguments
+//	time is in ns since the epoch (system_clock, taken by the caller).
+//	types has two bytes per argument : kind ('i' signed, 'u' unsigned, 'f' floating, 'p' pointer,
+//	's' c string) and sizeof. binary mode takes arithmetic, enum, pointer and c string arguments only
+//--------------------------------------------------------------------------------------------------
+
+namespace async_print {
+
+	typedef void (*format_fn)(std::string& out, const char* fmt, const char* func, const unsigned char* args);
+#if PRINT_BINARY
+	// args == nullptr : append the argument type codes instead of the arguments
+	typedef void (*encode_fn)(std::string& out, const unsigned char* args);
+
+	static constexpr char binary_magic[] = "PRTBIN01";
+	static constexpr size_t binary_magic_size = sizeof(binary_magic) - 1;
+	static constexpr uint8_t binary_tag_format = 1;
+	static constexpr uint8_t binary_tag_record = 2;
+#endif
+
+	// argument encoding in the ring
+	template <class A>
+	struct arg_codec {
+		static_assert(std::is_trivially_copyable<A>::value, "async_print : argument is not trivially copyable");
+		typedef A value_type;
+
+		static inline size_t size(const A&) { return sizeof(A); }
+
+		static inline unsigned char* put(unsigned char* p, const A& _Val) {
+			memcpy(p, &_Val, sizeof(A));
+			return p + sizeof(A);
+		}
+
+		static inline A get(const unsigned char*& p) {
+			A ret;
+			memcpy(&ret, p, sizeof(A));
+			p += sizeof(A);
+			return ret;
+		}
+	};
+
+	// c strings are copied with their terminator; the formatter reads them in place
+	struct c_string_codec {
+		typedef const char* value_type;
+
+		static inline size_t size(const char* _Val) { return sizeof(uint32_t) + strlen(_Val ? _Val : "(null)") + 1; }
+
+		static inline unsigned char* put(unsigned char* p, const char* _Val) {
+			if (_Val == nullptr)
+				_Val = "(null)";
+			const uint32_t len = (uint32_t)strlen(_Val) + 1;
+			memcpy(p, &len, sizeof(len));
+			memcpy(p + sizeof(len), _Val, len);
+			return p + sizeof(len) + len;
+		}
+
+		static inline const char* get(const unsigned char*& p) {
+			uint32_t len;
+			memcpy(&len, p, sizeof(len));
+			const char* ret = (const char*)(p + sizeof(len));
+			p += sizeof(len) + len;
+			return ret;
+		}
+	};
+
+	template <> struct arg_codec<const char*> : c_string_codec {};
+
+	// type a call argument is stored as. arrays and char* become const char*
+	template <class A>
+	struct stored {
+		typedef std::decay_t<A> type;
+	};
+	template <class A>
+	struct stored<A*> {
+		typedef typename std::conditional<std::is_same<std::remove_cv_t<A>, char>::value, const char*, A*>::type type;
+	};
+	template <class A>
+	using stored_t = typename stored<std::decay_t<A>>::type;
+
+	template <class... A>
+	inline size_t args_size(const A&... args) {
+		size_t ret = 0;
+		(void)std::initializer_list<int>{ (ret += arg_codec<A>::size(args), 0)... };
+		return ret;
+	}
+
+	template <class... A>
+	inline void put_args(unsigned char* p, const A&... args) {
+		(void)std::initializer_list<int>{ (p = arg_codec<A>::put(p, args), 0)... };
+		(void)p;
+	}
+
+	template <class Tup, size_t... I>
+	inline int format_tuple(char* dst, size_t cap, const char* fmt, const char* func, const Tup& tup, std::index_sequence<I...>) {
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+#endif
+		return snprintf(dst, cap, fmt, func, std::get<I>(tup)...);
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+	}
+
+	// instantiated once per argument type list, its address is stored in every record
+	template <class... A>
+	void format_record(std::string& out, const char* fmt, const char* func, const unsigned char* args) {
+		// braced init evaluates left to right
+		const std::tuple<typename arg_codec<A>::value_type...> tup{ arg_codec<A>::get(args)... };
+		(void)args;
+		const size_t at = out.size();
+		size_t cap = 256;
+		for (;;) {
+			out.resize(at + cap);
+			const int n = format_tuple(&out[at], cap, fmt, func, tup, std::index_sequence_for<A...>{});
+			if (n < 0) {
+				out.resize(at);
+				return;
+			}
+			if ((size_t)n < cap) {
+				out.resize(at + n);
+				return;
+			}
+			cap = (size_t)n + 1;
+		}
+	}
+
+#if PRINT_BINARY
+	template <class A, class = void>
+	struct type_code {
+		static_assert(std::is_arithmetic<A>::value, "async_print : binary mode takes arithmetic, enum, pointer and c string arguments");
+		static constexpr char kind = std::is_floating_point<A>::value ? 'f' : std::is_signed<A>::value ? 'i' : 'u';
+		static constexpr char size = (char)sizeof(A);
+	};
+
+	template <class A>
+	struct type_code<A, std::enable_if_t<std::is_enum<A>::value>> : type_code<std::underlying_type_t<A>> {};
+
+	template <class A>
+	struct type_code<A*, void> {
+		static constexpr char kind = 'p';
+		static constexpr char size = (char)sizeof(A*);
+	};
+
+	template <>
+	struct type_code<const char*, void> {
+		static constexpr char kind = 's';
+		static constexpr char size = 1;
+	};
+
+	template <class Tp>
+	inline void put_serdes(std::string& out, const Tp& _Val) {
+		const size_t at = out.size();
+		out.resize(at + SerDesLittle::payload_size(_Val));
+		SerDesLittle::serialize((uint8_t*)&out[at], _Val);
+	}
+
+	// instantiated once per argument type list, like format_record
+	template <class... A>
+	void encode_record(std::string& out, const unsigned char* args) {
+		if (args == nullptr) {
+			(void)std::initializer_list<int>{ (out += type_code<A>::kind, out += type_code<A>::size, 0)... };
+			return;
+		}
+		const std::tuple<typename arg_codec<A>::value_type...> tup{ arg_codec<A>::get(args)... };
+		put_serdes(out, tup);
+	}
+
+	inline uint64_t now_ns() {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+#endif
+
+	struct record_header {
+		uint32_t size;		// whole record, multiple of 8
+		uint32_t padding;	// 1 : skip to the ring start, no record
+		format_fn format;
+		const char* fmt;
+		const char* func;
+#if PRINT_BINARY
+		encode_fn encode;
+		uint64_t time;
+#endif
+	};
+
+	// single producer (the owning thread) / single consumer (the backend) byte ring
+	class thread_ring
+	{
+	public:
+		static constexpr size_t capacity = PRINT_ASYNC_RING_SIZE;
+		static_assert((capacity & (capacity - 1)) == 0 && capacity >= 1024, "PRINT_ASYNC_RING_SIZE must be a power of 2");
+
+		thread_ring() : _buf(new unsigned char[capacity]) {}
+		~thread_ring() { delete[] _buf; }
+
+		thread_ring(const thread_ring&) = delete;
+		thread_ring& operator= (const thread_ring&) = delete;
+
+		// producer. return nullptr : the record can never fit, or stop was set while the ring was full
+		unsigned char* reserve(size_t size, const std::atomic<bool>& stop) {
+			if (size > capacity / 2)
+				return nullptr;
+			const size_t w = _write.load(std::memory_order_relaxed);
+			const size_t offset = w & (capacity - 1);
+			const size_t skip = offset + size > capacity ? capacity - offset : 0;
+			// blocking only while the backend is behind by a whole ring. nothing drains after stop
+			while (w + skip + size - _cached_read > capacity) {
+				_cached_read = _read.load(std::memory_order_acquire);
+				if (w + skip + size - _cached_read > capacity) {
+					if (stop.load(std::memory_order_relaxed))
+						return nullptr;
+					std::this_thread::yield();
+				}
+			}
+			if (skip) {
+				record_header* pad = (record_header*)(_buf + offset);
+				pad->size = (uint32_t)skip;
+				pad->padding = 1;
+				_pending = skip;
+				return _buf;
+			}
+			_pending = 0;
+			return _buf + offset;
+		}
+
+		// producer. publish the record written into reserve()
+		inline void commit(size_t size) {
+			_write.store(_write.load(std::memory_order_relaxed) + _pending + size, std::memory_order_release);
+		}
+
+		// consumer. pass everything published so far to f(const record_header*)
+		template <class F>
+		bool drain(F&& f) {
+			size_t r = _read.load(std::memory_order_relaxed);
+			const size_t w = _write.load(std::memory_order_acquire);
+			if (r == w)
+				return false;
+			while (r != w) {
+				const record_header* h = (const record_header*)(_buf + (r & (capacity - 1)));
+				if (!h->padding)
+					f(h);
+				r += h->size;
+			}
+			_read.store(r, std::memory_order_release);
+			return true;
+		}
+
+		inline bool empty() const {
+			return _read.load(std::memory_order_acquire) == _write.load(std::memory_order_acquire);
+		}
+
+		std::atomic<bool> retired{ false };		// owner thread exited, delete once drained
+
+	private:
+		// producer and consumer positions on separate cache lines
+		unsigned char* const _buf;
+		alignas(64) std::atomic<size_t> _write{ 0 };
+		size_t _cached_read{ 0 };		// producer only
+		size_t _pending{ 0 };			// producer only. padding bytes before the reserved record
+		alignas(64) std::atomic<size_t> _read{ 0 };
+	};
+
+	class backend
+	{
+	public:
+		// immortal : threads may still log while statics are destroyed
+		static backend& get() {
+			static backend* b = new backend;
+			return *b;
+		}
+
+		inline bool stopped() const {
+			return _stopped.load(std::memory_order_relaxed);
+		}
+
+		// return nullptr : this thread already destroyed its thread_locals (e.g. main thread
+		// during static destruction), the ring may be deleted by now. log synchronously
+		thread_ring* local_ring() {
+			// trivially destructible, still readable after h is destroyed
+			static thread_local bool dead = false;
+			struct holder {
+				thread_ring* ring{ nullptr };
+				~holder() {
+					if (ring)
+						ring->retired.store(true, std::memory_order_release);
+					ring = nullptr;
+					dead = true;
+				}
+			};
+			if (dead)
+				return nullptr;
+			static thread_local holder h;
+			if (h.ring == nullptr) {
+				h.ring = new thread_ring;
+				std::lock_guard<std::mutex> lock(_rings_mutex);
+				_rings.push_back(h.ring);
+			}
+			return h.ring;
+		}
+
+		// records still queued go to the new output
+		void set_output(FILE* out) {
+			std::lock_guard<std::mutex> lock(_write_mutex);
+			_out = out;
+#if PRINT_BINARY
+			_started = false;
+			_ids.clear();
+#endif
+		}
+
+		// blocking function
+		// return after every record logged before the call is written
+		void flush() {
+			if (stopped())
+				return;
+			std::unique_lock<std::mutex> lock(_wake_mutex);
+			const uint64_t gen = ++_flush_requested;
+			_wake.notify_one();
+			_flushed_cv.wait(lock, [&] { return _flushed >= gen || stopped(); });
+		}
+
+		// return nullptr : use write_record
+		inline unsigned char* reserve(thread_ring* ring, size_t size) {
+			return ring->reserve(size, _stopped);
+		}
+
+		// a commit racing with shutdown_at_exit may land after its last drain, then write it here
+		void commit(thread_ring* ring, size_t size) {
+			ring->commit(size);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (stopped()) {
+				std::string batch;
+				drain_all(batch);
+			}
+		}
+
+		// synchronous path : after shutdown, or a record larger than half a ring
+		void write_record(const record_header* h) {
+			std::lock_guard<std::mutex> lock(_write_mutex);
+			std::string out;
+			append(out, h);
+			fwrite(out.data(), 1, out.size(), _out);
+			fflush(_out);
+		}
+
+	private:
+		backend() : _out(stdout) {
+			_thread = std::thread([this]() { run(); });
+			atexit(shutdown_at_exit);
+		}
+
+		static void shutdown_at_exit() {
+			backend& b = get();
+			{
+				std::lock_guard<std::mutex> lock(b._wake_mutex);
+				b._stopped.store(true, std::memory_order_seq_cst);
+				b._wake.notify_one();
+				b._flushed_cv.notify_all();
+			}
+			if (b._thread.joinable())
+				b._thread.join();
+			// calls racing with exit may still have been queued. commit() drains what lands after this
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::string batch;
+			b.drain_all(batch);
+		}
+
+		// caller holds _write_mutex
+		void append(std::string& out, const record_header* h) {
+			const unsigned char* args = (const unsigned char*)(h + 1);
+#if PRINT_BINARY
+			if (!_started) {
+				out.append(binary_magic, binary_magic_size);
+				_started = true;
+			}
+			const auto key = std::make_tuple(h->fmt, h->func, h->encode);
+			auto it = _ids.find(key);
+			if (it == _ids.end()) {
+				it = _ids.emplace(key, (uint32_t)_ids.size()).first;
+				std::string types;
+				h->encode(types, nullptr);
+				put_serdes(out, std::make_tuple(binary_tag_format, it->second, h->func, h->fmt, types.c_str()));
+			}
+			put_serdes(out, std::make_tuple(binary_tag_record, it->second, h->time));
+			h->encode(out, args);
+#else
+			h->format(out, h->fmt, h->func, args);
+#endif
+		}
+
+		// one pass over every ring. return true : something was written
+		bool drain_all(std::string& batch) {
+			batch.clear();
+			std::lock_guard<std::mutex> write_lock(_write_mutex);
+			{
+				std::lock_guard<std::mutex> lock(_rings_mutex);
+				for (size_t i = 0; i < _rings.size();) {
+					thread_ring* ring = _rings[i];
+					const bool retired = ring->retired.load(std::memory_order_acquire);
+					ring->drain([&](const record_header* h) { append(batch, h); });
+					if (retired && ring->empty()) {
+						delete ring;
+						_rings[i] = _rings.back();
+						_rings.pop_back();
+						continue;
+					}
+					++i;
+				}
+			}
+			if (batch.empty())
+				return false;
+			fwrite(batch.data(), 1, batch.size(), _out);
+			fflush(_out);
+			return true;
+		}
+
+		void run() {
+			std::string batch;
+			batch.reserve(thread_ring::capacity);
+			uint64_t served = 0;
+			while (!stopped()) {
+				uint64_t requested;
+				{
+					std::lock_guard<std::mutex> lock(_wake_mutex);
+					requested = _flush_requested;
+				}
+				const bool wrote = drain_all(batch);
+				{
+					std::unique_lock<std::mutex> lock(_wake_mutex);
+					if (requested != served) {
+						served = requested;
+						_flushed = requested;
+						_flushed_cv.notify_all();
+					}
+					if (!wrote && _flush_requested == served)
+						_wake.wait_for(lock, std::chrono::microseconds(PRINT_ASYNC_POLL_US));
+				}
+			}
+		}
+
+		std::mutex _rings_mutex;
+		std::vector<thread_ring*> _rings;
+		std::mutex _write_mutex;
+		FILE* _out;
+#if PRINT_BINARY
+		bool _started{ false };		// magic written to _out
+		std::map<std::tuple<const char*, const char*, encode_fn>, uint32_t> _ids;
+#endif
+		std::mutex _wake_mutex;
+		std::condition_variable _wake;
+		std::condition_variable _flushed_cv;
+		uint64_t _flush_requested{ 0 };
+		uint64_t _flushed{ 0 };
+		std::atomic<bool> _stopped{ false };
+		std::thread _thread;
+	};
+
+	// non blocking function (unless this thread's ring is full)
+	template <class... Args>
+	void log(const char* fmt, const char* func, const Args&... args) {
+		backend& b = backend::get();
+		const size_t size = (sizeof(record_header) + args_size<stored_t<Args>...>(args...) + 7) & ~(size_t)7;
+		thread_ring* ring = b.stopped() ? nullptr : b.local_ring();
+		unsigned char* p = ring ? b.reserve(ring, size) : nullptr;
+		std::vector<uint64_t> tmp;
+		if (p == nullptr) {
+			tmp.resize(size / sizeof(uint64_t));
+			p = (unsigned char*)tmp.data();
+		}
+		record_header* h = (record_header*)p;
+		h->size = (uint32_t)size;
+		h->padding = 0;
+		h->format = &format_record<stored_t<Args>...>;
+		h->fmt = fmt;
+		h->func = func;
+#if PRINT_BINARY
+		h->encode = &encode_record<stored_t<Args>...>;
+		h->time = now_ns();
+#endif
+		put_args<stored_t<Args>...>((unsigned char*)(h + 1), args...);
+		if (tmp.empty())
+			b.commit(ring, size);
+		else
+			b.write_record(h);
+	}
+
+	inline void flush() {
+		backend::get().flush();
+	}
+
+	// default stdout
+	inline void set_output(FILE* out) {
+		backend::get().set_output(out);
+	}
+
+} // namespace async_print
+
+#endif // !__ASYNC_PRINT_HPP__
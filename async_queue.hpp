@@ -0,0 +1,292 @@
+// revision 1.0 by luj
+// for cross platform, C++20 (coroutines)
+
+#pragma once
+#ifndef __ASYNC_QUEUE_HPP__
+#define __ASYNC_QUEUE_HPP__
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include "thread_pool.hpp"
+
+// coroutine detached on start. the frame frees itself when the body ends
+struct fire_and_forget
+{
+	struct promise_type {
+		fire_and_forget get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+// co_await resume_on(pool) : continue the coroutine on one of the executor's threads
+template <class Executor>
+auto resume_on(Executor& executor) {
+	struct awaiter {
+		Executor& executor;
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> h) { executor.post([h]() { h.resume(); }); }
+		void await_resume() const noexcept {}
+	};
+	return awaiter{ executor };
+}
+
+// safe_deque for coroutines. pop / push suspend the coroutine instead of blocking the thread,
+// and the waiter is resumed through the executor (any type with post(F)) when data / space appears.
+//	std::optional<T> v = co_await q.pop();	// nullopt : queue closed
+//	bool ok = co_await q.push(v);			// false : queue closed
+// executor == nullptr resumes the waiter inline on the thread that made the progress.
+// try_push / try_pull are for plain threads and wake suspended coroutines too
+template <class T, class Executor = thread_pool>
+class async_queue
+{
+public:
+	class pop_awaiter
+	{
+	public:
+		bool await_ready() const noexcept { return false; }
+		bool await_suspend(std::coroutine_handle<> h) {
+			_handle = h;
+			return _queue._suspend_pop(this);
+		}
+		std::optional<T> await_resume() { return std::move(_value); }
+
+	private:
+		friend class async_queue;
+		explicit pop_awaiter(async_queue& q) : _queue(q) {}
+
+		async_queue& _queue;
+		std::coroutine_handle<> _handle;
+		std::optional<T> _value;
+		pop_awaiter* _next{ nullptr };
+	};
+
+	class push_awaiter
+	{
+	public:
+		bool await_ready() const noexcept { return false; }
+		bool await_suspend(std::coroutine_handle<> h) {
+			_handle = h;
+			return _queue._suspend_push(this);
+		}
+		bool await_resume() const noexcept { return _ok; }
+
+	private:
+		friend class async_queue;
+		push_awaiter(async_queue& q, T&& v) : _queue(q), _value(std::move(v)) {}
+
+		async_queue& _queue;
+		std::coroutine_handle<> _handle;
+		T _value;
+		bool _ok{ false };
+		push_awaiter* _next{ nullptr };
+	};
+
+	// capacity == 0 : unbounded, push never suspends
+	explicit async_queue(Executor* executor = nullptr, size_t capacity = 0)
+		: _executor(executor), _capacity(capacity) {}
+
+	~async_queue() {
+		close();
+	}
+
+	async_queue(const async_queue&) = delete;
+	async_queue& operator= (const async_queue&) = delete;
+
+	[[nodiscard]] pop_awaiter pop() {
+		return pop_awaiter(*this);
+	}
+
+	[[nodiscard]] push_awaiter push(T _Val) {
+		return push_awaiter(*this, std::move(_Val));
+	}
+
+	// non blocking function
+	// return false : queue is full or closed
+	bool try_push(T _Val) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (_closed)
+			return false;
+		if (pop_awaiter* w = _pop_waiters.pop()) {
+			w->_value.emplace(std::move(_Val));
+			const std::coroutine_handle<> h = w->_handle;
+			lock.unlock();
+			_resume(h);
+			return true;
+		}
+		if (_full())
+			return false;
+		_items.push_back(std::move(_Val));
+		return true;
+	}
+
+	// non blocking function
+	// return false : queue is empty
+	bool try_pull(T& item) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (_items.empty())
+			return false;
+		item = std::move(_items.front());
+		_items.pop_front();
+		const std::coroutine_handle<> h = _admit_push_waiter();
+		lock.unlock();
+		if (h)
+			_resume(h);
+		return true;
+	}
+
+	// wake every waiter. pending pops get nullopt, pending pushes get false.
+	// items already queued can still be pulled
+	void close() {
+		pop_awaiter* pops;
+		push_awaiter* pushes;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_closed = true;
+			pops = _pop_waiters.take_all();
+			pushes = _push_waiters.take_all();
+		}
+		while (pops) {
+			pop_awaiter* next = pops->_next;
+			_resume(pops->_handle);
+			pops = next;
+		}
+		while (pushes) {
+			push_awaiter* next = pushes->_next;
+			pushes->_ok = false;
+			_resume(pushes->_handle);
+			pushes = next;
+		}
+	}
+
+	bool closed() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _closed;
+	}
+
+	bool empty() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _items.empty();
+	}
+
+	size_t size() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _items.size();
+	}
+
+private:
+	// intrusive fifo of suspended awaiters (they live in the coroutine frames)
+	template <class W>
+	struct waiter_list {
+		void push(W* w) {
+			w->_next = nullptr;
+			if (tail)
+				tail->_next = w;
+			else
+				head = w;
+			tail = w;
+		}
+
+		W* pop() {
+			W* w = head;
+			if (w) {
+				head = w->_next;
+				if (head == nullptr)
+					tail = nullptr;
+			}
+			return w;
+		}
+
+		W* take_all() {
+			W* w = head;
+			head = tail = nullptr;
+			return w;
+		}
+
+		W* head{ nullptr };
+		W* tail{ nullptr };
+	};
+
+	inline bool _full() const {
+		return _capacity && _items.size() >= _capacity;
+	}
+
+	void _resume(std::coroutine_handle<> h) {
+		if (_executor)
+			_executor->post([h]() { h.resume(); });
+		else
+			h.resume();
+	}
+
+	// caller holds the lock. moves the first blocked push into the freed slot
+	std::coroutine_handle<> _admit_push_waiter() {
+		push_awaiter* w = _push_waiters.pop();
+		if (w == nullptr)
+			return nullptr;
+		_items.push_back(std::move(w->_value));
+		w->_ok = true;
+		return w->_handle;
+	}
+
+	// return true : suspended (nothing may touch w after the unlock)
+	bool _suspend_pop(pop_awaiter* w) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (!_items.empty()) {
+			w->_value.emplace(std::move(_items.front()));
+			_items.pop_front();
+			const std::coroutine_handle<> h = _admit_push_waiter();
+			lock.unlock();
+			if (h)
+				_resume(h);
+			return false;
+		}
+		if (_closed)
+			return false;
+		_pop_waiters.push(w);
+		return true;
+	}
+
+	// return true : suspended (nothing may touch w after the unlock)
+	bool _suspend_push(push_awaiter* w) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (_closed) {
+			w->_ok = false;
+			return false;
+		}
+		if (pop_awaiter* p = _pop_waiters.pop()) {
+			p->_value.emplace(std::move(w->_value));
+			const std::coroutine_handle<> h = p->_handle;
+			lock.unlock();
+			w->_ok = true;
+			_resume(h);
+			return false;
+		}
+		if (!_full()) {
+			_items.push_back(std::move(w->_value));
+			w->_ok = true;
+			return false;
+		}
+		_push_waiters.push(w);
+		return true;
+	}
+
+	Executor* _executor;
+	const size_t _capacity;
+	std::mutex _mutex;
+	std::deque<T> _items;
+	waiter_list<pop_awaiter> _pop_waiters;
+	waiter_list<push_awaiter> _push_waiters;
+	bool _closed{ false };
+};
+
+#endif // C++20
+
+#endif // !__ASYNC_QUEUE_HPP__
@@ -0,0 +1,190 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __BROADCAST_RINGBUFFER_HPP__
+#define __BROADCAST_RINGBUFFER_HPP__
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <initializer_list>
+#include "assert.h"
+#include "dynamic_ringbuffer.hpp"
+#include "wait_policy.hpp"
+
+// disruptor style multicast ring. one producer writes every item once,
+// each registered consumer reads it through its own sequence cursor.
+//	- the producer is gated by the slowest consumer
+//	- a consumer may depend on other consumers, it only sees items they have already released
+// lock free: producer and consumers only exchange atomic cursors
+template <class T>
+class broadcast_ringbuffer :
+	protected ring_storage<T>
+{
+private:
+	typedef ring_storage<T> _Arr;
+	static constexpr unsigned spin_count = 2048;
+	static constexpr unsigned yield_count = 64;
+public:
+	typedef size_t consumer_id;
+
+	// capacity is rounded up to a power of two
+	explicit broadcast_ringbuffer(size_t capacity, bool huge_page = false)
+		: _Arr(capacity, huge_page) {}
+
+	// register every consumer before the producer starts
+	// depends_on : consumers which must release an item before this one can see it
+	consumer_id add_consumer(std::initializer_list<consumer_id> depends_on = {}) {
+		assert(_published.load(std::memory_order_relaxed) == 0 && "add consumers before publishing");
+		std::unique_ptr<consumer> c(new consumer);
+		for (auto dep : depends_on) {
+			assert(dep < _consumers.size() && "unknown dependency");
+			c->deps.push_back(&_consumers[dep]->cursor);
+		}
+		_consumers.push_back(std::move(c));
+		return _consumers.size() - 1;
+	}
+
+	// ---------------------------
+	// producer (single thread)
+	// ---------------------------
+
+	// return count of contiguous writable slots from ptr (at most n)
+	size_t reserve(T*& ptr, size_t n) {
+		const size_t pub = _published.load(std::memory_order_relaxed);
+		size_t free_slots = capacity() - (pub - _gate);
+		if (free_slots < n) {
+			_gate = gating_sequence();
+			free_slots = capacity() - (pub - _gate);
+		}
+		ptr = &_Arr::slot(pub);
+		return std::min({ n, free_slots, capacity() - (pub & _Arr::mask()) });
+	}
+
+	// publish n slots written through reserve()
+	void commit(size_t n = 1) {
+		const size_t pub = _published.load(std::memory_order_relaxed);
+		assert(n <= capacity() - (pub - _gate) && "ringbuffer overrun");
+		_published.store(pub + n, std::memory_order_release);
+		_ec.notify_all();
+	}
+
+	// return false : slowest consumer has not released enough space
+	bool push_back(const T& _Val) {
+		T* slot;
+		if (reserve(slot, 1) == 0)
+			return false;
+		*slot = _Val;
+		commit(1);
+		return true;
+	}
+
+	// blocking (spin & yield) until the slowest consumer frees a slot
+	void push_back_wait(const T& _Val) {
+		unsigned spin = 0;
+		while (!push_back(_Val)) {
+			if (++spin < spin_count)
+				cpu_relax();
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	// ---------------------------
+	// consumer (one thread per consumer_id)
+	// ---------------------------
+
+	// return count of contiguous readable slots from ptr (at most n)
+	size_t peek(consumer_id id, const T*& ptr, size_t n) {
+		consumer& c = *_consumers[id];
+		const size_t cur = c.cursor.load(std::memory_order_relaxed);
+		ptr = &_Arr::slot(cur);
+		return std::min({ n, available(c) - cur, capacity() - (cur & _Arr::mask()) });
+	}
+
+	// free n slots read through peek()
+	void release(consumer_id id, size_t n = 1) {
+		consumer& c = *_consumers[id];
+		const size_t cur = c.cursor.load(std::memory_order_relaxed);
+		c.cursor.store(cur + n, std::memory_order_release);
+		_ec.notify_all();
+	}
+
+	// return false : nothing available for this consumer
+	bool pull_front(consumer_id id, T& item) {
+		const T* slot;
+		if (peek(id, slot, 1) == 0)
+			return false;
+		item = *slot;
+		release(id, 1);
+		return true;
+	}
+
+	// blocking function
+	// return false : wait_break() was called
+	bool pull_front_wait(consumer_id id, T& item) {
+		const uint32_t brk = _break.load(std::memory_order_acquire);
+		for (;;) {
+			if (pull_front(id, item))
+				return true;
+			const uint32_t key = _ec.prepare_wait();
+			if (pull_front(id, item)) {
+				_ec.cancel_wait();
+				return true;
+			}
+			if (_break.load(std::memory_order_acquire) != brk) {
+				_ec.cancel_wait();
+				return false;
+			}
+			_ec.template wait<spin_count, yield_count>(key);
+		}
+	}
+
+	void wait_break() {
+		_break.fetch_add(1, std::memory_order_release);
+		_ec.notify_all();
+	}
+
+	// items published but not yet released by this consumer
+	size_t size(consumer_id id) {
+		consumer& c = *_consumers[id];
+		return _published.load(std::memory_order_acquire) - c.cursor.load(std::memory_order_relaxed);
+	}
+
+	size_t capacity() const noexcept {
+		return _Arr::capacity();
+	}
+
+private:
+	struct alignas(64) consumer {
+		std::atomic<size_t> cursor{ 0 };
+		std::vector<const std::atomic<size_t>*> deps;
+	};
+
+	size_t available(const consumer& c) const {
+		size_t limit = _published.load(std::memory_order_acquire);
+		for (auto dep : c.deps)
+			limit = std::min(limit, dep->load(std::memory_order_acquire));
+		return limit;
+	}
+
+	size_t gating_sequence() const {
+		size_t gate = _published.load(std::memory_order_relaxed);
+		for (auto& c : _consumers)
+			gate = std::min(gate, c->cursor.load(std::memory_order_acquire));
+		return gate;
+	}
+
+	std::vector<std::unique_ptr<consumer>> _consumers;
+	eventcount _ec;
+	std::atomic<uint32_t> _break{ 0 };
+
+	// producer owned
+	alignas(64) std::atomic<size_t> _published{ 0 };
+	size_t _gate{ 0 };
+};
+
+#endif // !__BROADCAST_RINGBUFFER_HPP__
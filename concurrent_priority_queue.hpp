@@ -0,0 +1,255 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __CONCURRENT_PRIORITY_QUEUE_HPP__
+#define __CONCURRENT_PRIORITY_QUEUE_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "wait_policy.hpp"
+
+// relaxed concurrent priority queue (MultiQueue).
+// items are spread over several heaps, each with its own lock.
+//	- push locks one random heap (try_lock, moves on when it is busy)
+//	- pull_min try_locks two random heaps and pops the smaller top
+// pull_min returns one of the smallest items, not always the smallest: the rank error grows
+// with the heap count, which is fine for deadline / priority scheduling and scales with threads.
+// Compare is a strict weak "less", pull_min takes the least item first
+template <class T, class Compare = std::less<T>>
+class concurrent_priority_queue
+{
+private:
+	static constexpr unsigned spin_count = 2048;
+	static constexpr unsigned yield_count = 64;
+
+	// min heap adapter for the std heap algorithms (which build max heaps)
+	struct greater {
+		Compare comp;
+		bool operator()(const T& a, const T& b) const { return comp(b, a); }
+	};
+
+	struct alignas(64) heap {
+		std::mutex mutex;
+		std::vector<T> items;
+		std::atomic<size_t> count{ 0 };
+	};
+
+public:
+	// heaps == 0 : two per hardware thread
+	explicit concurrent_priority_queue(size_t heaps = 0, const Compare& comp = Compare()) {
+		if (heaps == 0) {
+			const unsigned hw = std::thread::hardware_concurrency();
+			heaps = 2 * (hw ? hw : 1);
+		}
+		_heap_count = heaps < 2 ? 2 : heaps;
+		_heaps.reset(new heap[_heap_count]);
+		_greater.comp = comp;
+	}
+
+#if __cplusplus > 201402L && (defined(__GNUC__) ? __GNUC__ > 6 : true)
+	~concurrent_priority_queue() {
+		if constexpr (std::is_pointer_v<T>) {
+			T del;
+			while (pull_min(del))
+				delete del;
+		}
+	}
+#else
+	~concurrent_priority_queue() {
+		deallocator();
+	}
+
+private:
+
+	// only pointer template pull_min & delete
+	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	void deallocator() {
+		T del;
+		while (pull_min(del))
+			delete del;
+	}
+
+	// not pointer template. do notting
+	template <class _Ty = T, typename std::enable_if< !std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	void deallocator() {}
+
+public:
+#endif
+
+	concurrent_priority_queue(const concurrent_priority_queue&) = delete;
+	concurrent_priority_queue& operator= (const concurrent_priority_queue&) = delete;
+
+	inline void push(const T& _Val) {
+		_push(T(_Val));
+	}
+
+	inline void push(T&& _Val) {
+		_push(std::move(_Val));
+	}
+
+	inline void push_notify(const T& _Val) {
+		_push(T(_Val));
+		_ec.notify_one();
+	}
+
+	inline void push_notify(T&& _Val) {
+		_push(std::move(_Val));
+		_ec.notify_one();
+	}
+
+	// non blocking function
+	// return true : pull min success (one of the smallest items)
+	// return false : queue is empty
+	bool pull_min(T& item) {
+		for (unsigned attempt = 0; _size.load(std::memory_order_acquire) != 0; ++attempt) {
+			if (attempt >= 2 * _heap_count) {
+				// heavy contention or few non empty heaps. a blocking sweep always makes progress
+				if (_pull_sweep(item))
+					return true;
+				continue;
+			}
+
+			heap& a = _heaps[next_random() % _heap_count];
+			heap& b = _heaps[next_random() % _heap_count];
+			std::unique_lock<std::mutex> la(a.mutex, std::try_to_lock);
+			std::unique_lock<std::mutex> lb;
+			if (&b != &a)
+				lb = std::unique_lock<std::mutex>(b.mutex, std::try_to_lock);
+
+			heap* best = nullptr;
+			if (la.owns_lock() && !a.items.empty())
+				best = &a;
+			if (lb.owns_lock() && !b.items.empty() && (best == nullptr || _greater(best->items.front(), b.items.front())))
+				best = &b;
+			if (best) {
+				_pop(*best, item);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// blocking funtion
+	// return true : pull min success
+	// return false : woken by wait_break
+	bool pull_min_wait(T& item) {
+		if (pull_min(item))
+			return true;
+		const uint32_t gen = _break.load(std::memory_order_acquire);
+		for (;;) {
+			const uint32_t key = _ec.prepare_wait();
+			if (pull_min(item)) {
+				_ec.cancel_wait();
+				return true;
+			}
+			if (_break.load(std::memory_order_acquire) != gen) {
+				_ec.cancel_wait();
+				return false;
+			}
+			_ec.template wait<spin_count, yield_count>(key);
+		}
+	}
+
+	// return false : wait timeout or woken by wait_break
+	template<class _Rep, class _Period>
+	bool pull_min_wait(T& item, const std::chrono::duration<_Rep, _Period>& _Rel_time) {
+		if (pull_min(item))
+			return true;
+		const auto deadline = std::chrono::steady_clock::now() + _Rel_time;
+		const uint32_t gen = _break.load(std::memory_order_acquire);
+		for (;;) {
+			const uint32_t key = _ec.prepare_wait();
+			if (pull_min(item)) {
+				_ec.cancel_wait();
+				return true;
+			}
+			const auto now = std::chrono::steady_clock::now();
+			if (_break.load(std::memory_order_acquire) != gen || now >= deadline) {
+				_ec.cancel_wait();
+				return false;
+			}
+			_ec.template wait_for<spin_count, yield_count>(key, deadline - now);
+		}
+	}
+
+	// every pull_min_wait blocked right now returns false once woken.
+	// wakes one sleeping waiter per call (and all spinning ones), call it once per consumer
+	inline void wait_break() {
+		_break.fetch_add(1, std::memory_order_acq_rel);
+		_ec.notify_one();
+	}
+
+	bool empty() const noexcept {
+		return _size.load(std::memory_order_acquire) == 0;
+	}
+
+	size_t size() const noexcept {
+		return _size.load(std::memory_order_acquire);
+	}
+
+private:
+	static uint32_t next_random() noexcept {
+		static thread_local uint32_t state = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id()) | 1u;
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	void _push(T&& _Val) {
+		for (;;) {
+			heap& h = _heaps[next_random() % _heap_count];
+			std::unique_lock<std::mutex> lock(h.mutex, std::try_to_lock);
+			if (!lock.owns_lock())
+				continue;
+			h.items.push_back(std::move(_Val));
+			std::push_heap(h.items.begin(), h.items.end(), _greater);
+			h.count.store(h.items.size(), std::memory_order_relaxed);
+			_size.fetch_add(1, std::memory_order_release);
+			return;
+		}
+	}
+
+	// caller holds h.mutex, h is not empty
+	void _pop(heap& h, T& item) {
+		std::pop_heap(h.items.begin(), h.items.end(), _greater);
+		item = std::move(h.items.back());
+		h.items.pop_back();
+		h.count.store(h.items.size(), std::memory_order_relaxed);
+		_size.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+	bool _pull_sweep(T& item) {
+		const size_t start = next_random() % _heap_count;
+		for (size_t i = 0; i < _heap_count; ++i) {
+			heap& h = _heaps[(start + i) % _heap_count];
+			if (h.count.load(std::memory_order_relaxed) == 0)
+				continue;
+			std::lock_guard<std::mutex> lock(h.mutex);
+			if (!h.items.empty()) {
+				_pop(h, item);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::unique_ptr<heap[]> _heaps;
+	size_t _heap_count{ 0 };
+	greater _greater;
+	alignas(64) std::atomic<size_t> _size{ 0 };
+	eventcount _ec;
+	std::atomic<uint32_t> _break{ 0 };	// wait_break generation
+};
+
+#endif // !__CONCURRENT_PRIORITY_QUEUE_HPP__
@@ -0,0 +1,207 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __CONTAINER_STATS_HPP__
+#define __CONTAINER_STATS_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+//--------------------------------------------------------------------------------------------------
+// Stats policies for safe_deque / safe_ringbuffer
+//	no_stats         : default. every hook is an empty inline function, the lock is a plain lock_guard
+//	striped_stats<N> : relaxed counters in N cache line sized stripes, one stripe per thread (round robin).
+//	                   summed on demand by stats(). lock wait is timed only when try_lock fails
+//--------------------------------------------------------------------------------------------------
+
+static constexpr size_t container_stats_buckets = 32;
+
+struct container_stats {
+	uint64_t pushes;			// items pushed
+	uint64_t pulls;				// items pulled / released (evictions included)
+	uint64_t push_full;			// pushes refused because the container was full (or push wait timed out)
+	uint64_t evictions;			// items dropped by push_back_force
+	uint64_t empty_wakeups;		// blocking pulls woken with nothing to pull
+	uint64_t lock_acquisitions;
+	uint64_t lock_contended;	// acquisitions that had to wait
+	uint64_t lock_wait_ns;
+	uint64_t lock_hold_ns;		// non blocking functions only. waits release the lock inside the wait policy
+	uint64_t depth_histogram[container_stats_buckets];	// depth after push. bucket 0 : 0, bucket k : [2^(k-1), 2^k)
+};
+
+struct no_stats
+{
+	typedef int lock_token;
+	static constexpr bool enabled = false;
+
+	inline lock_token lock(std::mutex& m) { m.lock(); return 0; }
+	inline void unlock(std::mutex& m, lock_token) { m.unlock(); }
+	inline std::unique_lock<std::mutex> unique_lock(std::mutex& m) { return std::unique_lock<std::mutex>(m); }
+
+	inline void on_push(size_t, size_t) {}
+	inline void on_pull(size_t) {}
+	inline void on_push_full() {}
+	inline void on_evict() {}
+	inline void on_empty_wakeup() {}
+
+	container_stats snapshot() const { return container_stats(); }
+	void reset() {}
+};
+
+template <size_t stripes = 16>
+class striped_stats
+{
+public:
+	typedef std::chrono::steady_clock::time_point lock_token;
+	static constexpr bool enabled = true;
+
+	inline lock_token lock(std::mutex& m) {
+		stripe& s = local();
+		if (!m.try_lock()) {
+			const auto t0 = std::chrono::steady_clock::now();
+			m.lock();
+			add(s.lock_wait_ns, elapsed_ns(t0));
+			add(s.lock_contended, 1);
+		}
+		add(s.lock_acquisitions, 1);
+		return std::chrono::steady_clock::now();
+	}
+
+	inline void unlock(std::mutex& m, lock_token t0) {
+		const uint64_t hold = elapsed_ns(t0);
+		m.unlock();
+		add(local().lock_hold_ns, hold);
+	}
+
+	inline std::unique_lock<std::mutex> unique_lock(std::mutex& m) {
+		stripe& s = local();
+		std::unique_lock<std::mutex> lock(m, std::try_to_lock);
+		if (!lock.owns_lock()) {
+			const auto t0 = std::chrono::steady_clock::now();
+			lock.lock();
+			add(s.lock_wait_ns, elapsed_ns(t0));
+			add(s.lock_contended, 1);
+		}
+		add(s.lock_acquisitions, 1);
+		return lock;
+	}
+
+	inline void on_push(size_t n, size_t depth) {
+		stripe& s = local();
+		add(s.pushes, n);
+		add(s.depth_histogram[bucket(depth)], 1);
+	}
+
+	inline void on_pull(size_t n) { add(local().pulls, n); }
+	inline void on_push_full() { add(local().push_full, 1); }
+	inline void on_evict() { add(local().evictions, 1); }
+	inline void on_empty_wakeup() { add(local().empty_wakeups, 1); }
+
+	container_stats snapshot() const {
+		container_stats ret = container_stats();
+		for (auto& s : _stripes) {
+			ret.pushes += s.pushes.load(std::memory_order_relaxed);
+			ret.pulls += s.pulls.load(std::memory_order_relaxed);
+			ret.push_full += s.push_full.load(std::memory_order_relaxed);
+			ret.evictions += s.evictions.load(std::memory_order_relaxed);
+			ret.empty_wakeups += s.empty_wakeups.load(std::memory_order_relaxed);
+			ret.lock_acquisitions += s.lock_acquisitions.load(std::memory_order_relaxed);
+			ret.lock_contended += s.lock_contended.load(std::memory_order_relaxed);
+			ret.lock_wait_ns += s.lock_wait_ns.load(std::memory_order_relaxed);
+			ret.lock_hold_ns += s.lock_hold_ns.load(std::memory_order_relaxed);
+			for (size_t k = 0; k < container_stats_buckets; ++k)
+				ret.depth_histogram[k] += s.depth_histogram[k].load(std::memory_order_relaxed);
+		}
+		return ret;
+	}
+
+	// not atomic with respect to concurrent updates
+	void reset() {
+		for (auto& s : _stripes) {
+			s.pushes.store(0, std::memory_order_relaxed);
+			s.pulls.store(0, std::memory_order_relaxed);
+			s.push_full.store(0, std::memory_order_relaxed);
+			s.evictions.store(0, std::memory_order_relaxed);
+			s.empty_wakeups.store(0, std::memory_order_relaxed);
+			s.lock_acquisitions.store(0, std::memory_order_relaxed);
+			s.lock_contended.store(0, std::memory_order_relaxed);
+			s.lock_wait_ns.store(0, std::memory_order_relaxed);
+			s.lock_hold_ns.store(0, std::memory_order_relaxed);
+			for (auto& h : s.depth_histogram)
+				h.store(0, std::memory_order_relaxed);
+		}
+	}
+
+private:
+	struct alignas(64) stripe {
+		std::atomic<uint64_t> pushes{ 0 };
+		std::atomic<uint64_t> pulls{ 0 };
+		std::atomic<uint64_t> push_full{ 0 };
+		std::atomic<uint64_t> evictions{ 0 };
+		std::atomic<uint64_t> empty_wakeups{ 0 };
+		std::atomic<uint64_t> lock_acquisitions{ 0 };
+		std::atomic<uint64_t> lock_contended{ 0 };
+		std::atomic<uint64_t> lock_wait_ns{ 0 };
+		std::atomic<uint64_t> lock_hold_ns{ 0 };
+		std::atomic<uint64_t> depth_histogram[container_stats_buckets];
+
+		stripe() {
+			for (auto& h : depth_histogram)
+				h.store(0, std::memory_order_relaxed);
+		}
+	};
+
+	static inline void add(std::atomic<uint64_t>& c, uint64_t n) {
+		c.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	static inline uint64_t elapsed_ns(std::chrono::steady_clock::time_point t0) {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+	}
+
+	static inline size_t bucket(size_t depth) {
+		size_t k = 0;
+#if defined(__GNUC__)
+		if (depth)
+			k = 64 - __builtin_clzll((unsigned long long)depth);
+#else
+		while (depth) {
+			++k;
+			depth >>= 1;
+		}
+#endif
+		return k < container_stats_buckets ? k : container_stats_buckets - 1;
+	}
+
+	// threads get stripes round robin, so up to `stripes` threads never share a line
+	inline stripe& local() {
+		static std::atomic<unsigned> next_stripe{ 0 };
+		static thread_local unsigned idx = next_stripe.fetch_add(1, std::memory_order_relaxed) % stripes;
+		return _stripes[idx];
+	}
+
+	stripe _stripes[stripes];
+};
+
+// lock_guard that reports wait / hold time to a stats policy
+template <class Stats>
+class stats_lock_guard
+{
+public:
+	stats_lock_guard(std::mutex& m, Stats& s) : _m(m), _s(s), _token(s.lock(m)) {}
+	~stats_lock_guard() { _s.unlock(_m, _token); }
+
+	stats_lock_guard(const stats_lock_guard&) = delete;
+	stats_lock_guard& operator= (const stats_lock_guard&) = delete;
+
+private:
+	std::mutex& _m;
+	Stats& _s;
+	typename Stats::lock_token _token;
+};
+
+#endif // !__CONTAINER_STATS_HPP__
@@ -0,0 +1,396 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __DYNAMIC_RINGBUFFER_HPP__
+#define __DYNAMIC_RINGBUFFER_HPP__
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <memory>
+#include <algorithm>
+#include "assert.h"
+#include "ring_iterator.hpp"
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// heap backed slot storage for the runtime sized ringbuffers
+// capacity is rounded up to a power of two, so a free running index is wrapped with a single mask
+template <class T>
+class ring_storage
+{
+public:
+	static constexpr size_t cache_line = 64;
+	static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+	static constexpr size_t round_up_pow2(size_t n) noexcept {
+		size_t ret = 1;
+		while (ret < n)
+			ret <<= 1;
+		return ret;
+	}
+
+	// huge_page : try MAP_HUGETLB first, then fall back to transparent huge pages (linux only)
+	explicit ring_storage(size_t capacity, bool huge_page = false)
+		: _capacity(round_up_pow2(capacity ? capacity : 1))
+		, _mask(_capacity - 1)
+	{
+		_data = static_cast<T*>(allocate(_capacity * sizeof(T), huge_page));
+		size_t constructed = 0;
+		try {
+			for (; constructed < _capacity; ++constructed)
+				new (_data + constructed) T();
+		}
+		catch (...) {
+			destroy(constructed);
+			throw;
+		}
+	}
+
+	~ring_storage() {
+		destroy(_capacity);
+	}
+
+	ring_storage(const ring_storage&) = delete;
+	ring_storage& operator= (const ring_storage&) = delete;
+
+	inline T& slot(size_t idx) noexcept {
+		return _data[idx & _mask];
+	}
+
+	inline const T& slot(size_t idx) const noexcept {
+		return _data[idx & _mask];
+	}
+
+	inline T* data() noexcept {
+		return _data;
+	}
+
+	inline size_t capacity() const noexcept {
+		return _capacity;
+	}
+
+	inline size_t mask() const noexcept {
+		return _mask;
+	}
+
+private:
+	static constexpr size_t alignment =
+		alignof(T) > cache_line ? alignof(T) : cache_line;
+
+	void* allocate(size_t bytes, bool huge_page) {
+#ifdef __linux__
+		if (huge_page) {
+			_mapped = (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+			void* ptr = mmap(nullptr, _mapped, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (ptr == MAP_FAILED) {
+				ptr = mmap(nullptr, _mapped, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (ptr == MAP_FAILED)
+					throw std::bad_alloc();
+				madvise(ptr, _mapped, MADV_HUGEPAGE);
+			}
+			return ptr;
+		}
+#else
+		(void)huge_page;
+#endif
+		bytes = (bytes + alignment - 1) & ~(alignment - 1);
+#ifdef _WIN32
+		void* ptr = _aligned_malloc(bytes, alignment);
+#else
+		void* ptr = nullptr;
+		if (posix_memalign(&ptr, alignment, bytes) != 0)
+			ptr = nullptr;
+#endif
+		if (ptr == nullptr)
+			throw std::bad_alloc();
+		return ptr;
+	}
+
+	void destroy(size_t constructed) noexcept {
+		for (size_t i = 0; i < constructed; ++i)
+			_data[i].~T();
+#ifdef __linux__
+		if (_mapped) {
+			munmap(_data, _mapped);
+			return;
+		}
+#endif
+#ifdef _WIN32
+		_aligned_free(_data);
+#else
+		free(_data);
+#endif
+	}
+
+	T* _data{ nullptr };
+	const size_t _capacity;
+	const size_t _mask;
+	size_t _mapped{ 0 };
+};
+
+// same interface as ringbuffer<T, _Size, use_sum>, but the capacity is chosen at runtime
+template <class T, bool use_sum = false>
+class dynamic_ringbuffer :
+	protected ring_storage<T>
+{
+private:
+	static constexpr bool sum_en = !std::is_pointer<T>::value && use_sum;
+	typedef ring_storage<T> _Arr;
+public:
+	typedef ring_iterator<dynamic_ringbuffer, T> iterator;
+	typedef ring_iterator<const dynamic_ringbuffer, const T> const_iterator;
+
+	// capacity is rounded up to a power of two
+	explicit dynamic_ringbuffer(size_t capacity, bool huge_page = false)
+		: _Arr(capacity, huge_page) {}
+
+#if __cplusplus > 201402L && (defined(__GNUC__) ? __GNUC__ > 6 : true)
+	//if you want this code in MSVC, add this C++ Commandline Option [ /Zc:__cplusplus /std:c++17 ]
+	~dynamic_ringbuffer() {
+		if constexpr (std::is_pointer_v<T>) {
+			T del;
+			while (pull_front(del))
+				delete del;
+		}
+	}
+#else
+	~dynamic_ringbuffer() {
+		deallocator();
+	}
+
+private:
+	// only pointer template pull_front & delete
+	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	void deallocator() {
+		T del;
+		while (pull_front(del))
+			delete del;
+	}
+
+	// not pointer template. do notting
+	template <class _Ty = T, typename std::enable_if< !std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	void deallocator() {}
+
+public:
+#endif
+
+	// allocates a shared_ptr control block per call. hot paths should use object_pool<T> (object_pool.hpp)
+	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	auto pull_front_auto_recycle() {
+		using T_nptr = typename std::remove_pointer<T>::type;
+		T tmp = nullptr;
+		if (!pull_front(tmp))
+			tmp = new T_nptr;
+		return std::shared_ptr<T_nptr>(tmp, [&](T del) { push_back_force(del); });
+	}
+
+	// return false : buffer is full
+	bool push_back(T& _Val) {
+		if (!full()) {
+			incr_back(_Val);
+			return true;
+		}
+		return false;
+	}
+
+	// return false : buffer is full
+	bool push_back(const T& _Val) {
+		if (!full()) {
+			incr_back(_Val);
+			return true;
+		}
+		return false;
+	}
+
+	void push_back_force(T& _Val) {
+		_if_full_delete_once();
+		incr_back(_Val);
+	}
+
+	void push_back_force(const T& _Val) {
+		_if_full_delete_once();
+		incr_back(_Val);
+	}
+
+	// return false : buffer is empty
+	bool pull_front(T& item) {
+		if (_empty())
+			return false;
+		item = incr_front();
+		return true;
+	}
+
+	// zero copy producer side. write in place, then publish with commit()
+	// return nullptr : buffer is full
+	T* reserve() {
+		return full() ? nullptr : &_Arr::slot(_tail);
+	}
+
+	// return count of contiguous writable slots from ptr (at most n)
+	size_t reserve(T*& ptr, size_t n) {
+		ptr = &_Arr::slot(_tail);
+		return std::min({ n, capacity() - size(), capacity() - (_tail & _Arr::mask()) });
+	}
+
+	// publish n slots written through reserve()
+	void commit(size_t n = 1) {
+		assert(n <= capacity() - size() && "ringbuffer overrun");
+		if constexpr (sum_en) {
+			for (size_t i = 0; i < n; ++i)
+				_sum += _Arr::slot(_tail + i);
+		}
+		_tail += n;
+	}
+
+	// zero copy consumer side. read in place, then free with release()
+	// return nullptr : buffer is empty
+	T* peek() {
+		return _empty() ? nullptr : &_Arr::slot(_head);
+	}
+
+	// return count of contiguous readable slots from ptr (at most n)
+	size_t peek(T*& ptr, size_t n) {
+		ptr = &_Arr::slot(_head);
+		return std::min({ n, size(), capacity() - (_head & _Arr::mask()) });
+	}
+
+	// free n slots read through peek()
+	void release(size_t n = 1) {
+		assert(n <= size() && "ringbuffer underrun");
+		if constexpr (sum_en) {
+			for (size_t i = 0; i < n; ++i)
+				_sum -= _Arr::slot(_head + i);
+		}
+		_head += n;
+	}
+
+	auto empty() {
+		return _tail == _head;
+	}
+
+	auto full() {
+		return _tail - _head == capacity();
+	}
+
+	auto size() noexcept {
+		return _tail - _head;
+	}
+
+	void fill(const T& _Val) {
+		for (size_t i = 0; i < capacity(); ++i)
+			_Arr::data()[i] = _Val;
+		if constexpr (sum_en)
+			_sum = _Val * (T)size();
+	}
+
+	void clear() {
+		_head = 0;
+		_tail = 0;
+		if constexpr (sum_en)
+			_sum = 0;
+	}
+
+	auto capacity() const noexcept {
+		return _Arr::capacity();
+	}
+
+	// logical index, 0 is front
+	T& operator[](size_t idx) {
+		return _Arr::slot(_head + idx);
+	}
+
+	const T& operator[](size_t idx) const {
+		return _Arr::slot(_head + idx);
+	}
+
+	iterator begin() {
+		return iterator(this, 0);
+	}
+
+	iterator end() {
+		return iterator(this, _tail - _head);
+	}
+
+	const_iterator begin() const {
+		return const_iterator(this, 0);
+	}
+
+	const_iterator end() const {
+		return const_iterator(this, _tail - _head);
+	}
+
+	auto& front() {
+		return _Arr::slot(_head);
+	}
+
+	auto& back() {
+		return _Arr::slot(_tail - 1);
+	}
+
+	// contents as (at most) two contiguous segments, front part first
+	ring_spans<T> as_spans() {
+		const size_t len = _tail - _head;
+		const size_t n0 = std::min(len, capacity() - (_head & _Arr::mask()));
+		return ring_spans<T>({ &_Arr::slot(_head), n0 }, { _Arr::data(), len - n0 });
+	}
+
+	template <class _Ty = T>
+	std::enable_if_t<sum_en, _Ty> sum() {
+		return _sum;
+	}
+
+private:
+
+	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	inline void _if_full_delete_once() {
+		if (full()) {
+			T dummy = incr_front();
+			delete dummy;
+		}
+	}
+
+	template <class _Ty = T, typename std::enable_if< !std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	inline void _if_full_delete_once() {
+		if (full())
+			T dummy = incr_front();
+	}
+
+	inline bool _empty() {
+		return _tail == _head;
+	}
+
+	void incr_back(const T& _Val) {
+		assert(!full() && "ringbuffer overrun");
+		_Arr::slot(_tail++) = _Val;
+		if constexpr (sum_en)
+			_sum += _Val;
+	};
+
+	void incr_back(T&& _Val) {
+		assert(!full() && "ringbuffer overrun");
+		if constexpr (sum_en)
+			_sum += _Val;
+		_Arr::slot(_tail++) = std::move(_Val);
+	};
+
+	T&& incr_front() {
+		assert(!_empty() && "ringbuffer underrun");
+		if constexpr (sum_en)
+			_sum -= _Arr::slot(_head);
+		return std::move(_Arr::slot(_head++));
+	}
+
+	// free running indices. size is always (_tail - _head)
+	size_t _tail{ 0 };
+	size_t _head{ 0 };
+
+	T _sum{};
+};
+
+#endif // !__DYNAMIC_RINGBUFFER_HPP__
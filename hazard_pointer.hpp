@@ -0,0 +1,169 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __HAZARD_POINTER_HPP__
+#define __HAZARD_POINTER_HPP__
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <utility>
+
+// safe memory reclamation for the lock free containers.
+// a reader publishes the pointer it is about to dereference in one of its hazard slots,
+// a writer retires unlinked nodes and they are deleted only once no hazard slot holds them.
+//	p = hazard_pointers::protect(0, src);	// p stays valid ...
+//	hazard_pointers::clear(0);				// ... until cleared
+//	hazard_pointers::retire(unlinked);		// delete when unprotected
+class hazard_pointers
+{
+public:
+	static constexpr size_t slots_per_thread = 2;
+
+	// load src and publish it in the calling thread's hazard slot
+	template <class P>
+	static P* protect(size_t slot, const std::atomic<P*>& src) noexcept {
+		std::atomic<void*>& hp = local().rec->hp[slot];
+		P* ptr = src.load(std::memory_order_relaxed);
+		for (;;) {
+			hp.store(ptr, std::memory_order_seq_cst);
+			P* again = src.load(std::memory_order_seq_cst);
+			if (again == ptr)
+				return ptr;
+			ptr = again;
+		}
+	}
+
+	static void clear(size_t slot) noexcept {
+		local().rec->hp[slot].store(nullptr, std::memory_order_release);
+	}
+
+	// delete p (with delete) once no thread protects it any more
+	template <class P>
+	static void retire(P* p) {
+		thread_state& ts = local();
+		ts.retired.emplace_back(static_cast<void*>(p), [](void* ptr) { delete static_cast<P*>(ptr); });
+		if (ts.retired.size() >= scan_threshold())
+			scan(ts);
+	}
+
+private:
+	typedef void(*deleter_t)(void*);
+	typedef std::pair<void*, deleter_t> retired_t;
+
+	struct record {
+		std::atomic<void*> hp[slots_per_thread];
+		std::atomic<bool> active{ true };
+		record* next{ nullptr };
+
+		record() {
+			for (auto& h : hp)
+				h.store(nullptr, std::memory_order_relaxed);
+		}
+	};
+
+	struct domain {
+		~domain() {
+			for (auto& r : orphans)
+				r.second(r.first);
+			record* rec = head.load(std::memory_order_acquire);
+			while (rec) {
+				record* next = rec->next;
+				delete rec;
+				rec = next;
+			}
+		}
+
+		// records are never freed while the process runs, only recycled
+		record* acquire() {
+			for (record* rec = head.load(std::memory_order_acquire); rec; rec = rec->next) {
+				bool expected = false;
+				if (!rec->active.load(std::memory_order_relaxed) &&
+					rec->active.compare_exchange_strong(expected, true, std::memory_order_acquire))
+					return rec;
+			}
+			record* rec = new record;
+			record* old = head.load(std::memory_order_relaxed);
+			do {
+				rec->next = old;
+			} while (!head.compare_exchange_weak(old, rec, std::memory_order_release, std::memory_order_relaxed));
+			count.fetch_add(1, std::memory_order_relaxed);
+			return rec;
+		}
+
+		std::atomic<record*> head{ nullptr };
+		std::atomic<size_t> count{ 0 };
+
+		// retired nodes left behind by exited threads
+		std::mutex orphan_mutex;
+		std::vector<retired_t> orphans;
+	};
+
+	struct thread_state {
+		thread_state() : rec(get_domain().acquire()) {}
+
+		~thread_state() {
+			for (auto& h : rec->hp)
+				h.store(nullptr, std::memory_order_release);
+			scan(*this);
+			if (!retired.empty()) {
+				domain& d = get_domain();
+				std::lock_guard<std::mutex> lock(d.orphan_mutex);
+				d.orphans.insert(d.orphans.end(), retired.begin(), retired.end());
+			}
+			rec->active.store(false, std::memory_order_release);
+		}
+
+		record* rec;
+		std::vector<retired_t> retired;
+	};
+
+	static domain& get_domain() {
+		static domain d;
+		return d;
+	}
+
+	static thread_state& local() {
+		static thread_local thread_state ts;
+		return ts;
+	}
+
+	static size_t scan_threshold() {
+		const size_t n = 2 * slots_per_thread * get_domain().count.load(std::memory_order_relaxed);
+		return n < 64 ? 64 : n;
+	}
+
+	static void scan(thread_state& ts) {
+		domain& d = get_domain();
+
+		// adopt retired nodes of exited threads
+		{
+			std::unique_lock<std::mutex> lock(d.orphan_mutex, std::try_to_lock);
+			if (lock.owns_lock() && !d.orphans.empty()) {
+				ts.retired.insert(ts.retired.end(), d.orphans.begin(), d.orphans.end());
+				d.orphans.clear();
+			}
+		}
+
+		std::vector<void*> hazards;
+		for (record* rec = d.head.load(std::memory_order_acquire); rec; rec = rec->next) {
+			for (auto& h : rec->hp) {
+				void* p = h.load(std::memory_order_seq_cst);
+				if (p)
+					hazards.push_back(p);
+			}
+		}
+		std::sort(hazards.begin(), hazards.end());
+
+		auto keep = std::partition(ts.retired.begin(), ts.retired.end(), [&](const retired_t& r) {
+			return std::binary_search(hazards.begin(), hazards.end(), r.first);
+		});
+		for (auto it = keep; it != ts.retired.end(); ++it)
+			it->second(it->first);
+		ts.retired.erase(keep, ts.retired.end());
+	}
+};
+
+#endif // !__HAZARD_POINTER_HPP__
@@ -0,0 +1,278 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __LOCKFREE_QUEUE_HPP__
+#define __LOCKFREE_QUEUE_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include "hazard_pointer.hpp"
+#include "wait_policy.hpp"
+
+// unbounded lock free multi producer / multi consumer FIFO.
+// a linked list of fixed size segments; producers and consumers claim slots with one fetch_add
+// (FAA array queue). drained segments are reclaimed through hazard pointers.
+// same push / pull / wait interface as safe_deque for task and message queues
+template <class T, size_t segment_size = 1024>
+class lockfree_queue
+{
+private:
+	static constexpr unsigned spin_count = 2048;
+	static constexpr unsigned yield_count = 64;
+
+	enum : uint8_t { slot_empty = 0, slot_full = 1, slot_taken = 2 };
+
+	struct slot {
+		std::atomic<uint8_t> state{ slot_empty };
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+		T* value() noexcept {
+			return reinterpret_cast<T*>(&storage);
+		}
+	};
+
+	struct segment {
+		explicit segment(uint64_t id_) : id(id_) {}
+
+		~segment() {
+			for (auto& s : slots) {
+				if (s.state.load(std::memory_order_relaxed) == slot_full)
+					s.value()->~T();
+			}
+		}
+
+		alignas(64) std::atomic<size_t> deq{ 0 };
+		alignas(64) std::atomic<size_t> enq{ 0 };
+		alignas(64) std::atomic<segment*> next{ nullptr };
+		const uint64_t id;
+		slot slots[segment_size];
+	};
+
+public:
+	lockfree_queue() {
+		segment* s = new segment(0);
+		_head.store(s, std::memory_order_relaxed);
+		_tail.store(s, std::memory_order_relaxed);
+	}
+
+	~lockfree_queue() {
+#if __cplusplus > 201402L && (defined(__GNUC__) ? __GNUC__ > 6 : true)
+		if constexpr (std::is_pointer_v<T>) {
+			T del;
+			while (pull_front(del))
+				delete del;
+		}
+#else
+		deallocator();
+#endif
+		segment* s = _head.load(std::memory_order_relaxed);
+		while (s) {
+			segment* next = s->next.load(std::memory_order_relaxed);
+			delete s;
+			s = next;
+		}
+	}
+
+#if !(__cplusplus > 201402L && (defined(__GNUC__) ? __GNUC__ > 6 : true))
+private:
+
+	// only pointer template pull_front & delete
+	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	void deallocator() {
+		T del;
+		while (pull_front(del))
+			delete del;
+	}
+
+	// not pointer template. do notting
+	template <class _Ty = T, typename std::enable_if< !std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	void deallocator() {}
+
+public:
+#endif
+
+	lockfree_queue(const lockfree_queue&) = delete;
+	lockfree_queue& operator= (const lockfree_queue&) = delete;
+
+	inline void push_back(const T& _Val) {
+		enqueue(T(_Val));
+	}
+
+	inline void push_back(T&& _Val) {
+		enqueue(std::move(_Val));
+	}
+
+	inline void push_back_notify(const T& _Val) {
+		enqueue(T(_Val));
+		_ec.notify_one();
+	}
+
+	inline void push_back_notify(T&& _Val) {
+		enqueue(std::move(_Val));
+		_ec.notify_one();
+	}
+
+	// non blocking function
+	// return true : pull front success
+	// return false : queue is empty
+	bool pull_front(T& item) {
+		for (;;) {
+			segment* head = hazard_pointers::protect(0, _head);
+			if (head->deq.load(std::memory_order_acquire) >= head->enq.load(std::memory_order_acquire) &&
+				head->next.load(std::memory_order_acquire) == nullptr)
+				break;
+			const size_t idx = head->deq.fetch_add(1, std::memory_order_acq_rel);
+			if (idx < segment_size) {
+				slot& s = head->slots[idx];
+				// a producer that has not filled the slot yet finds it taken and retries elsewhere
+				if (s.state.exchange(slot_taken, std::memory_order_acq_rel) == slot_full) {
+					item = std::move(*s.value());
+					s.value()->~T();
+					hazard_pointers::clear(0);
+					return true;
+				}
+				continue;
+			}
+			segment* next = head->next.load(std::memory_order_acquire);
+			if (next == nullptr)
+				break;
+			// producers link next before they advance _tail. move _tail off head first,
+			// so a retired segment is never reachable from _tail
+			segment* tail = _tail.load(std::memory_order_acquire);
+			if (tail == head)
+				_tail.compare_exchange_strong(tail, next, std::memory_order_acq_rel, std::memory_order_acquire);
+			if (_head.compare_exchange_strong(head, next, std::memory_order_acq_rel)) {
+				hazard_pointers::clear(0);
+				hazard_pointers::retire(head);
+			}
+		}
+		hazard_pointers::clear(0);
+		return false;
+	}
+
+	// blocking funtion
+	// return true : pull front success
+	// return false : woken by wait_break
+	bool pull_front_wait(T& item) {
+		if (pull_front(item))
+			return true;
+		const uint32_t gen = _break.load(std::memory_order_acquire);
+		for (;;) {
+			const uint32_t key = _ec.prepare_wait();
+			if (pull_front(item)) {
+				_ec.cancel_wait();
+				return true;
+			}
+			if (_break.load(std::memory_order_acquire) != gen) {
+				_ec.cancel_wait();
+				return false;
+			}
+			_ec.template wait<spin_count, yield_count>(key);
+		}
+	}
+
+	// return false : wait timeout or woken by wait_break
+	template<class _Rep, class _Period>
+	bool pull_front_wait(T& item, const std::chrono::duration<_Rep, _Period>& _Rel_time) {
+		if (pull_front(item))
+			return true;
+		const auto deadline = std::chrono::steady_clock::now() + _Rel_time;
+		const uint32_t gen = _break.load(std::memory_order_acquire);
+		for (;;) {
+			const uint32_t key = _ec.prepare_wait();
+			if (pull_front(item)) {
+				_ec.cancel_wait();
+				return true;
+			}
+			const auto now = std::chrono::steady_clock::now();
+			if (_break.load(std::memory_order_acquire) != gen || now >= deadline) {
+				_ec.cancel_wait();
+				return false;
+			}
+			_ec.template wait_for<spin_count, yield_count>(key, deadline - now);
+		}
+	}
+
+	// every pull_front_wait blocked right now returns false once woken.
+	// wakes one sleeping waiter per call (and all spinning ones), call it once per consumer
+	inline void wait_break() {
+		_break.fetch_add(1, std::memory_order_acq_rel);
+		_ec.notify_one();
+	}
+
+	// snapshot, may be stale by the time it returns
+	bool empty() {
+		segment* head = hazard_pointers::protect(0, _head);
+		const bool ret = head->deq.load(std::memory_order_acquire) >= head->enq.load(std::memory_order_acquire) &&
+			head->next.load(std::memory_order_acquire) == nullptr;
+		hazard_pointers::clear(0);
+		return ret;
+	}
+
+	// approximate. claimed but unfilled slots are counted
+	size_t size() {
+		segment* head = hazard_pointers::protect(0, _head);
+		segment* tail = hazard_pointers::protect(1, _tail);
+		const size_t deq = std::min(head->deq.load(std::memory_order_acquire), segment_size);
+		const size_t enq = std::min(tail->enq.load(std::memory_order_acquire), segment_size);
+		const size_t total = tail->id >= head->id ? (size_t)(tail->id - head->id) * segment_size + enq : 0;
+		hazard_pointers::clear(1);
+		hazard_pointers::clear(0);
+		return total > deq ? total - deq : 0;
+	}
+
+private:
+	void enqueue(T&& _Val) {
+		for (;;) {
+			segment* tail = hazard_pointers::protect(0, _tail);
+			const size_t idx = tail->enq.fetch_add(1, std::memory_order_acq_rel);
+			if (idx < segment_size) {
+				slot& s = tail->slots[idx];
+				new (&s.storage) T(std::move(_Val));
+				uint8_t expected = slot_empty;
+				if (s.state.compare_exchange_strong(expected, slot_full, std::memory_order_release, std::memory_order_relaxed)) {
+					hazard_pointers::clear(0);
+					return;
+				}
+				// a consumer gave up on this slot. take the value back and retry
+				_Val = std::move(*s.value());
+				s.value()->~T();
+				continue;
+			}
+
+			if (tail != _tail.load(std::memory_order_acquire))
+				continue;
+			segment* next = tail->next.load(std::memory_order_acquire);
+			if (next == nullptr) {
+				segment* fresh = new segment(tail->id + 1);
+				new (&fresh->slots[0].storage) T(std::move(_Val));
+				fresh->slots[0].state.store(slot_full, std::memory_order_relaxed);
+				fresh->enq.store(1, std::memory_order_relaxed);
+				segment* null_seg = nullptr;
+				if (tail->next.compare_exchange_strong(null_seg, fresh, std::memory_order_release, std::memory_order_relaxed)) {
+					_tail.compare_exchange_strong(tail, fresh, std::memory_order_release, std::memory_order_relaxed);
+					hazard_pointers::clear(0);
+					return;
+				}
+				_Val = std::move(*fresh->slots[0].value());
+				delete fresh;
+			}
+			else {
+				_tail.compare_exchange_strong(tail, next, std::memory_order_release, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	alignas(64) std::atomic<segment*> _head{ nullptr };
+	alignas(64) std::atomic<segment*> _tail{ nullptr };
+	eventcount _ec;
+	std::atomic<uint32_t> _break{ 0 };	// wait_break generation
+};
+
+#endif // !__LOCKFREE_QUEUE_HPP__
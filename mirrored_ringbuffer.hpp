@@ -0,0 +1,186 @@
+// revision 1.0 by luj
+// linux only (memfd_create + double mmap)
+
+#pragma once
+#ifndef __MIRRORED_RINGBUFFER_HPP__
+#define __MIRRORED_RINGBUFFER_HPP__
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "assert.h"
+#include "dynamic_ringbuffer.hpp"
+
+// single producer / single consumer byte ring.
+// the same physical pages are mapped twice back to back, so every readable or writable region
+// (up to the capacity) is contiguous in memory even when it wraps around the end of the ring.
+// SerDes::deserialize, send and recv can therefore work directly on the ring memory.
+class mirrored_ringbuffer
+{
+public:
+	// capacity is rounded up to a power of two and to a multiple of the page size
+	explicit mirrored_ringbuffer(size_t capacity) {
+		const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		_capacity = ring_storage<uint8_t>::round_up_pow2(std::max(capacity, page));
+		_mask = _capacity - 1;
+
+		int fd = (int)syscall(SYS_memfd_create, "mirrored_ringbuffer", 0);
+		if (fd < 0)
+			throw std::system_error(errno, std::generic_category(), "memfd_create");
+		if (ftruncate(fd, (off_t)_capacity) != 0) {
+			int err = errno;
+			close(fd);
+			throw std::system_error(err, std::generic_category(), "ftruncate");
+		}
+
+		// reserve 2 x capacity of address space, then map the file over both halves
+		void* base = mmap(nullptr, _capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED) {
+			int err = errno;
+			close(fd);
+			throw std::system_error(err, std::generic_category(), "mmap reserve");
+		}
+		_data = static_cast<uint8_t*>(base);
+		for (size_t half = 0; half < 2; ++half) {
+			void* ptr = mmap(_data + half * _capacity, _capacity, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, fd, 0);
+			if (ptr == MAP_FAILED) {
+				int err = errno;
+				munmap(_data, _capacity * 2);
+				close(fd);
+				throw std::system_error(err, std::generic_category(), "mmap mirror");
+			}
+		}
+		close(fd);
+	}
+
+	~mirrored_ringbuffer() {
+		munmap(_data, _capacity * 2);
+	}
+
+	mirrored_ringbuffer(const mirrored_ringbuffer&) = delete;
+	mirrored_ringbuffer& operator= (const mirrored_ringbuffer&) = delete;
+
+	// producer side. ptr points to size_writable() contiguous bytes
+	size_t reserve(uint8_t*& ptr) noexcept {
+		const size_t tail = _tail.load(std::memory_order_relaxed);
+		ptr = _data + (tail & _mask);
+		return _capacity - (tail - _head.load(std::memory_order_acquire));
+	}
+
+	// publish n bytes written through reserve()
+	void commit(size_t n) noexcept {
+		const size_t tail = _tail.load(std::memory_order_relaxed);
+		assert(n <= _capacity - (tail - _head.load(std::memory_order_relaxed)) && "ringbuffer overrun");
+		_tail.store(tail + n, std::memory_order_release);
+	}
+
+	// consumer side. ptr points to size() contiguous bytes
+	size_t peek(uint8_t*& ptr) noexcept {
+		const size_t head = _head.load(std::memory_order_relaxed);
+		ptr = _data + (head & _mask);
+		return _tail.load(std::memory_order_acquire) - head;
+	}
+
+	// free n bytes read through peek()
+	void release(size_t n) noexcept {
+		const size_t head = _head.load(std::memory_order_relaxed);
+		assert(n <= _tail.load(std::memory_order_relaxed) - head && "ringbuffer underrun");
+		_head.store(head + n, std::memory_order_release);
+	}
+
+	// return false : not enough space for all n bytes
+	bool push_back(const void* src, size_t n) noexcept {
+		uint8_t* dst;
+		if (reserve(dst) < n)
+			return false;
+		memcpy(dst, src, n);
+		commit(n);
+		return true;
+	}
+
+	// return false : less than n bytes available
+	bool pull_front(void* dst, size_t n) noexcept {
+		uint8_t* src;
+		if (peek(src) < n)
+			return false;
+		memcpy(dst, src, n);
+		release(n);
+		return true;
+	}
+
+	// read(2) straight into the free region. return value of read, or 0 when the ring is full
+	ssize_t read_from(int fd) noexcept {
+		uint8_t* dst;
+		size_t n = reserve(dst);
+		if (n == 0)
+			return 0;
+		ssize_t ret = ::read(fd, dst, n);
+		if (ret > 0)
+			commit((size_t)ret);
+		return ret;
+	}
+
+	// write(2) straight from the readable region. return value of write, or 0 when the ring is empty
+	ssize_t write_to(int fd) noexcept {
+		uint8_t* src;
+		size_t n = peek(src);
+		if (n == 0)
+			return 0;
+		ssize_t ret = ::write(fd, src, n);
+		if (ret > 0)
+			release((size_t)ret);
+		return ret;
+	}
+
+	// any thread. head first : tail only grows, so it is never behind the head read before it.
+	// the ring may refill between the two loads, hence the clamp
+	size_t size() const noexcept {
+		const size_t head = _head.load(std::memory_order_acquire);
+		const size_t used = _tail.load(std::memory_order_acquire) - head;
+		return used < _capacity ? used : _capacity;
+	}
+
+	size_t size_writable() const noexcept {
+		return _capacity - size();
+	}
+
+	bool empty() const noexcept {
+		return size() == 0;
+	}
+
+	bool full() const noexcept {
+		return size() == _capacity;
+	}
+
+	// not thread safe. call only while producer and consumer are idle
+	void clear() noexcept {
+		_head.store(0, std::memory_order_relaxed);
+		_tail.store(0, std::memory_order_relaxed);
+	}
+
+	size_t capacity() const noexcept {
+		return _capacity;
+	}
+
+private:
+	uint8_t* _data{ nullptr };
+	size_t _capacity{ 0 };
+	size_t _mask{ 0 };
+
+	// free running indices on separate cache lines (producer owns _tail, consumer owns _head)
+	alignas(64) std::atomic<size_t> _tail{ 0 };
+	alignas(64) std::atomic<size_t> _head{ 0 };
+};
+
+#endif // __linux__
+
+#endif // !__MIRRORED_RINGBUFFER_HPP__
@@ -0,0 +1,408 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __OBJECT_POOL_HPP__
+#define __OBJECT_POOL_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include "assert.h"
+
+struct object_pool_stats {
+	size_t capacity;		// objects constructed by the pool
+	size_t in_use;			// handles currently alive
+	size_t high_water_mark;	// peak of objects outside the global free list (in use + per thread cached)
+	size_t grow_count;		// chunk allocations
+};
+
+// recycling pool of constructed T objects. replacement for pull_front_auto_recycle
+//	- acquire / release hit a per thread cache first, no atomics in the common case
+//	- per thread caches refill from and spill to a lock free global free list
+//	- handle is an intrusive pointer, no control block allocation
+//	- objects are not reconstructed on reuse (same as pull_front_auto_recycle)
+// handles must not outlive the pool
+template <class T>
+class object_pool
+{
+private:
+	struct core;
+
+	struct node {
+		T value;
+		std::atomic<uint32_t> next{ nil };
+		uint32_t index{ 0 };
+		core* owner{ nullptr };
+	};
+
+	static constexpr uint32_t nil = 0xffffffffu;
+	static constexpr size_t max_chunks = 32;
+
+public:
+	// move only owner of one pooled object. returns it to the pool on destruction
+	class handle
+	{
+	public:
+		handle() = default;
+		handle(const handle&) = delete;
+		handle& operator= (const handle&) = delete;
+		handle(handle&& other) noexcept : _node(other._node) { other._node = nullptr; }
+		handle& operator= (handle&& other) noexcept {
+			if (this != &other) {
+				reset();
+				_node = other._node;
+				other._node = nullptr;
+			}
+			return *this;
+		}
+		~handle() { reset(); }
+
+		void reset() {
+			if (_node) {
+				_node->owner->release(_node);
+				_node = nullptr;
+			}
+		}
+
+		T* get() const noexcept { return _node ? &_node->value : nullptr; }
+		T& operator*() const noexcept { return _node->value; }
+		T* operator->() const noexcept { return &_node->value; }
+		explicit operator bool() const noexcept { return _node != nullptr; }
+
+	private:
+		friend class object_pool;
+		explicit handle(node* n) noexcept : _node(n) {}
+		node* _node{ nullptr };
+	};
+
+	// prealloc    : objects constructed up front
+	// cache_size  : per thread cache size. half of it moves to / from the global list at once
+	explicit object_pool(size_t prealloc = 0, size_t cache_size = 64)
+		: _core(new core(cache_size < 2 ? 2 : cache_size)) {
+		if (prealloc)
+			reserve(prealloc);
+	}
+
+	~object_pool() {
+		assert(_core->in_use() == 0 && "object_pool destroyed with live handles");
+		_core->detach_caches();
+	}
+
+	object_pool(const object_pool&) = delete;
+	object_pool& operator= (const object_pool&) = delete;
+
+	handle acquire() {
+		return handle(_core->acquire());
+	}
+
+	// grow until at least n objects are constructed
+	void reserve(size_t n) {
+		while (_core->capacity.load(std::memory_order_acquire) < n)
+			_core->grow();
+	}
+
+	object_pool_stats stats() const {
+		return _core->stats();
+	}
+
+private:
+	// per thread cache for one pool. owner is cleared by the pool destructor,
+	// the owning thread deletes detached entries later
+	struct cache_entry {
+		std::atomic<core*> owner{ nullptr };
+		std::vector<node*> nodes;
+		// written by the owning thread only, summed on demand
+		std::atomic<int64_t> acquired{ 0 };
+		std::atomic<int64_t> released{ 0 };
+	};
+
+	struct thread_caches {
+		~thread_caches() {
+			caches_dead() = true;
+			std::lock_guard<std::mutex> lock(registry_mutex());
+			for (auto& c : entries) {
+				core* owner = c->owner.load(std::memory_order_acquire);
+				if (owner)
+					owner->unregister_cache(c.get());
+			}
+		}
+
+		cache_entry* find(core* owner) {
+			if (last && last->owner.load(std::memory_order_relaxed) == owner)
+				return last;
+			for (auto& c : entries) {
+				if (c->owner.load(std::memory_order_relaxed) == owner)
+					return last = c.get();
+			}
+			return nullptr;
+		}
+
+		std::vector<std::unique_ptr<cache_entry>> entries;
+		cache_entry* last{ nullptr };
+	};
+
+	// trivially destructible, so it is still readable after the thread's caches are gone
+	// (the main thread destroys its thread_locals before the statics)
+	static bool& caches_dead() noexcept {
+		static thread_local bool dead = false;
+		return dead;
+	}
+
+	// return nullptr : this thread's caches are already destroyed
+	static thread_caches* local_caches() {
+		if (caches_dead())
+			return nullptr;
+		static thread_local thread_caches caches;
+		return &caches;
+	}
+
+	// orders thread exit (unregister) against pool destruction (detach).
+	// never destroyed, threads may exit after static destruction
+	static std::mutex& registry_mutex() {
+		static std::mutex* m = new std::mutex;
+		return *m;
+	}
+
+	struct core {
+		explicit core(size_t cache_size_) : cache_size(cache_size_) {
+			for (auto& c : chunks)
+				c.store(nullptr, std::memory_order_relaxed);
+		}
+
+		~core() {
+			for (size_t k = 0; k < max_chunks; ++k) {
+				node* c = chunks[k].load(std::memory_order_relaxed);
+				if (c == nullptr)
+					break;
+				delete[] c;
+			}
+		}
+
+		node* acquire() {
+			thread_caches* tc = local_caches();
+			if (tc == nullptr) {
+				// this thread's caches are gone. take from the global list
+				node* n;
+				while ((n = pop()) == nullptr)
+					grow();
+				retired_acquired.fetch_add(1, std::memory_order_relaxed);
+				update_high_water_mark();
+				return n;
+			}
+			cache_entry& c = local_cache(*tc);
+			if (c.nodes.empty())
+				refill(c);
+			node* n = c.nodes.back();
+			c.nodes.pop_back();
+			c.acquired.store(c.acquired.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return n;
+		}
+
+		void release(node* n) {
+			thread_caches* tc = local_caches();
+			cache_entry* c = tc ? tc->find(this) : nullptr;
+			if (c == nullptr) {
+				// this thread never acquired from the pool, or its caches are gone. go straight to the global list
+				push_chain(n, n, 1);
+				retired_released.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			c->released.store(c->released.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			c->nodes.push_back(n);
+			if (c->nodes.size() >= cache_size)
+				spill(*c, cache_size / 2);
+		}
+
+		cache_entry& local_cache(thread_caches& tc) {
+			cache_entry* c = tc.find(this);
+			if (c)
+				return *c;
+
+			// drop entries detached by destroyed pools
+			tc.entries.erase(std::remove_if(tc.entries.begin(), tc.entries.end(),
+				[](const std::unique_ptr<cache_entry>& e) {
+					return e->owner.load(std::memory_order_acquire) == nullptr;
+				}), tc.entries.end());
+
+			std::unique_ptr<cache_entry> entry(new cache_entry);
+			entry->owner.store(this, std::memory_order_relaxed);
+			entry->nodes.reserve(cache_size);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				caches.push_back(entry.get());
+			}
+			tc.entries.push_back(std::move(entry));
+			return *(tc.last = tc.entries.back().get());
+		}
+
+		// pool destruction. no thread uses the pool any more, so the cached nodes are just dropped
+		void detach_caches() {
+			std::lock_guard<std::mutex> registry_lock(registry_mutex());
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto c : caches) {
+				std::vector<node*>().swap(c->nodes);
+				c->owner.store(nullptr, std::memory_order_release);
+			}
+			caches.clear();
+		}
+
+		// called with registry_mutex held
+		void unregister_cache(cache_entry* c) {
+			if (!c->nodes.empty())
+				spill(*c, c->nodes.size());
+			std::lock_guard<std::mutex> lock(mutex);
+			retired_acquired.fetch_add(c->acquired.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			retired_released.fetch_add(c->released.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			caches.erase(std::remove(caches.begin(), caches.end(), c), caches.end());
+		}
+
+		void refill(cache_entry& c) {
+			const size_t want = cache_size / 2;
+			while (c.nodes.size() < want) {
+				node* n = pop();
+				if (n == nullptr) {
+					if (c.nodes.empty())
+						grow();
+					else
+						break;
+					continue;
+				}
+				c.nodes.push_back(n);
+			}
+			update_high_water_mark();
+		}
+
+		void spill(cache_entry& c, size_t count) {
+			node* first = nullptr;
+			node* last = nullptr;
+			for (size_t i = 0; i < count; ++i) {
+				node* n = c.nodes.back();
+				c.nodes.pop_back();
+				if (last == nullptr)
+					last = n;
+				else
+					n->next.store(first->index, std::memory_order_relaxed);
+				first = n;
+			}
+			if (first)
+				push_chain(first, last, count);
+		}
+
+		// ---------------------------
+		// global free list. Treiber stack of node indices with an ABA tag
+		// ---------------------------
+
+		static inline uint64_t pack(uint32_t idx, uint32_t tag) {
+			return ((uint64_t)tag << 32) | idx;
+		}
+
+		node* at(uint32_t idx) const {
+			// chunk k holds chunk_base << k nodes, starting at chunk_base * (2^k - 1)
+			const uint64_t v = (uint64_t)idx / chunk_base + 1;
+			size_t k = 0;
+			while ((v >> (k + 1)) != 0)
+				++k;
+			node* c = chunks[k].load(std::memory_order_acquire);
+			return c + (idx - chunk_base * ((1ull << k) - 1));
+		}
+
+		node* pop() {
+			uint64_t old = free_head.load(std::memory_order_acquire);
+			for (;;) {
+				const uint32_t idx = (uint32_t)old;
+				if (idx == nil)
+					return nullptr;
+				node* n = at(idx);
+				const uint32_t next = n->next.load(std::memory_order_relaxed);
+				if (free_head.compare_exchange_weak(old, pack(next, (uint32_t)(old >> 32) + 1),
+					std::memory_order_acq_rel, std::memory_order_acquire)) {
+					free_count.fetch_sub(1, std::memory_order_relaxed);
+					return n;
+				}
+			}
+		}
+
+		// first -> ... -> last (count nodes) already linked through next
+		void push_chain(node* first, node* last, size_t count) {
+			free_count.fetch_add(count, std::memory_order_relaxed);
+			uint64_t old = free_head.load(std::memory_order_relaxed);
+			do {
+				last->next.store((uint32_t)old, std::memory_order_relaxed);
+			} while (!free_head.compare_exchange_weak(old, pack(first->index, (uint32_t)(old >> 32) + 1),
+				std::memory_order_release, std::memory_order_relaxed));
+		}
+
+		void grow() {
+			std::lock_guard<std::mutex> lock(mutex);
+			size_t k = 0;
+			while (k < max_chunks && chunks[k].load(std::memory_order_relaxed) != nullptr)
+				++k;
+			assert(k < max_chunks && "object_pool exhausted");
+			const size_t count = chunk_base << k;
+			const uint32_t base = (uint32_t)(chunk_base * ((1ull << k) - 1));
+			node* c = new node[count];
+			for (size_t i = 0; i < count; ++i) {
+				c[i].index = base + (uint32_t)i;
+				c[i].owner = this;
+				c[i].next.store(i + 1 < count ? base + (uint32_t)i + 1 : nil, std::memory_order_relaxed);
+			}
+			chunks[k].store(c, std::memory_order_release);
+			capacity.fetch_add(count, std::memory_order_release);
+			grow_count.fetch_add(1, std::memory_order_relaxed);
+			push_chain(&c[0], &c[count - 1], count);
+		}
+
+		void update_high_water_mark() {
+			const size_t cap = capacity.load(std::memory_order_relaxed);
+			const size_t free_nodes = free_count.load(std::memory_order_relaxed);
+			const size_t out = cap > free_nodes ? cap - free_nodes : 0;
+			size_t hwm = high_water_mark.load(std::memory_order_relaxed);
+			while (out > hwm && !high_water_mark.compare_exchange_weak(hwm, out, std::memory_order_relaxed)) {}
+		}
+
+		size_t in_use() {
+			std::lock_guard<std::mutex> lock(mutex);
+			int64_t acquired = retired_acquired.load(std::memory_order_relaxed);
+			int64_t released = retired_released.load(std::memory_order_relaxed);
+			for (auto c : caches) {
+				acquired += c->acquired.load(std::memory_order_relaxed);
+				released += c->released.load(std::memory_order_relaxed);
+			}
+			return acquired > released ? (size_t)(acquired - released) : 0;
+		}
+
+		object_pool_stats stats() {
+			object_pool_stats ret;
+			ret.capacity = capacity.load(std::memory_order_acquire);
+			ret.in_use = in_use();
+			ret.high_water_mark = high_water_mark.load(std::memory_order_relaxed);
+			ret.grow_count = grow_count.load(std::memory_order_relaxed);
+			return ret;
+		}
+
+		static constexpr size_t chunk_base = 64;
+
+		const size_t cache_size;
+		alignas(64) std::atomic<uint64_t> free_head{ pack(nil, 0) };
+		alignas(64) std::atomic<size_t> free_count{ 0 };
+		std::atomic<node*> chunks[max_chunks];
+		std::atomic<size_t> capacity{ 0 };
+		std::atomic<size_t> high_water_mark{ 0 };
+		std::atomic<size_t> grow_count{ 0 };
+
+		// cache registry and counters folded in from exited threads
+		std::mutex mutex;
+		std::vector<cache_entry*> caches;
+		std::atomic<int64_t> retired_acquired{ 0 };
+		std::atomic<int64_t> retired_released{ 0 };
+	};
+
+	std::unique_ptr<core> _core;
+};
+
+#endif // !__OBJECT_POOL_HPP__
@@ -0,0 +1,490 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __POOL_ALLOCATOR_HPP__
+#define __POOL_ALLOCATOR_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "assert.h"
+
+// allocators that keep the global heap off the hot paths.
+//	fixed_block_pool<N> : blocks of N bytes. per thread free list, batches move to / from a shared list
+//	size_class_pool     : power of two classes 16 .. 4096 on top of fixed_block_pool, larger sizes go to operator new
+//	monotonic_arena     : bump allocation, deallocate is a no-op, release() frees everything at once
+//	pool_allocator<T>   : STL allocator on size_class_pool (safe_deque<T, pool_allocator<T>>, command buffers)
+//	arena_allocator<T>  : STL allocator on a monotonic_arena (per request / per frame containers)
+
+struct allocator_stats {
+	uint64_t allocations;
+	uint64_t deallocations;
+	uint64_t bytes_in_use;		// bytes handed out and not yet returned
+	uint64_t bytes_reserved;	// bytes taken from the upstream allocator
+	uint64_t upstream_allocations;
+};
+
+// ---------------------------
+// fixed size blocks
+// ---------------------------
+
+// static pool of BlockSize byte blocks. memory is never returned to the OS (the shared state is immortal,
+// so blocks may be freed from any thread and during static destruction. once a thread's cache is destroyed
+// its calls go straight to the shared list)
+template <size_t BlockSize>
+class fixed_block_pool
+{
+	static_assert(BlockSize >= sizeof(void*), "fixed_block_pool block is smaller than a pointer");
+	static_assert(BlockSize % alignof(std::max_align_t) == 0 || alignof(std::max_align_t) % BlockSize == 0,
+		"fixed_block_pool block size must keep blocks aligned");
+
+	static constexpr size_t cache_limit = BlockSize <= 256 ? 256 : BlockSize <= 1024 ? 64 : 16;
+	static constexpr size_t chunk_bytes = BlockSize * 64 > 65536 ? BlockSize * 64 : 65536;
+
+public:
+	static void* allocate() {
+		cache* c = local();
+		if (c == nullptr)
+			return shared_allocate();
+		if (c->head == nullptr)
+			refill(*c);
+		free_node* n = c->head;
+		c->head = n->next;
+		--c->count;
+		c->allocations.store(c->allocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return n;
+	}
+
+	static void deallocate(void* p) noexcept {
+		cache* c = local();
+		if (c == nullptr) {
+			shared_deallocate(p);
+			return;
+		}
+		free_node* n = static_cast<free_node*>(p);
+		n->next = c->head;
+		c->head = n;
+		++c->count;
+		c->deallocations.store(c->deallocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		if (c->count >= cache_limit)
+			spill(*c, cache_limit / 2);
+	}
+
+	static allocator_stats stats() {
+		shared& s = get_shared();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		uint64_t allocs = s.retired_allocations;
+		uint64_t frees = s.retired_deallocations;
+		for (auto c : s.caches) {
+			allocs += c->allocations.load(std::memory_order_relaxed);
+			frees += c->deallocations.load(std::memory_order_relaxed);
+		}
+		allocator_stats ret;
+		ret.allocations = allocs;
+		ret.deallocations = frees;
+		ret.bytes_in_use = allocs > frees ? (allocs - frees) * BlockSize : 0;
+		ret.bytes_reserved = s.chunks.size() * chunk_bytes;
+		ret.upstream_allocations = s.chunks.size();
+		return ret;
+	}
+
+	static constexpr size_t block_size() noexcept {
+		return BlockSize;
+	}
+
+private:
+	struct free_node {
+		free_node* next;
+	};
+
+	struct cache;
+
+	struct shared {
+		std::mutex mutex;
+		std::vector<void*> chunks;
+		free_node* head{ nullptr };
+		size_t count{ 0 };
+		std::vector<cache*> caches;
+		uint64_t retired_allocations{ 0 };
+		uint64_t retired_deallocations{ 0 };
+	};
+
+	struct cache {
+		cache() {
+			shared& s = get_shared();
+			std::lock_guard<std::mutex> lock(s.mutex);
+			s.caches.push_back(this);
+		}
+
+		~cache() {
+			cache_dead() = true;
+			if (count)
+				spill(*this, count);
+			shared& s = get_shared();
+			std::lock_guard<std::mutex> lock(s.mutex);
+			s.retired_allocations += allocations.load(std::memory_order_relaxed);
+			s.retired_deallocations += deallocations.load(std::memory_order_relaxed);
+			s.caches.erase(std::remove(s.caches.begin(), s.caches.end(), this), s.caches.end());
+		}
+
+		free_node* head{ nullptr };
+		size_t count{ 0 };
+		// written by the owning thread only, summed by stats()
+		std::atomic<uint64_t> allocations{ 0 };
+		std::atomic<uint64_t> deallocations{ 0 };
+	};
+
+	static shared& get_shared() {
+		static shared* s = new shared;
+		return *s;
+	}
+
+	// trivially destructible, so it is still readable after the thread's cache is gone
+	// (the main thread destroys its thread_locals before the statics)
+	static bool& cache_dead() noexcept {
+		static thread_local bool dead = false;
+		return dead;
+	}
+
+	// return nullptr : this thread's cache is already destroyed
+	static cache* local() {
+		if (cache_dead())
+			return nullptr;
+		static thread_local cache c;
+		return &c;
+	}
+
+	// called with the shared lock held
+	static void grow(shared& s) {
+		char* chunk = static_cast<char*>(::operator new(chunk_bytes));
+		s.chunks.push_back(chunk);
+		for (size_t off = 0; off + BlockSize <= chunk_bytes; off += BlockSize) {
+			free_node* n = reinterpret_cast<free_node*>(chunk + off);
+			n->next = s.head;
+			s.head = n;
+			++s.count;
+		}
+	}
+
+	static void* shared_allocate() {
+		shared& s = get_shared();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		if (s.head == nullptr)
+			grow(s);
+		free_node* n = s.head;
+		s.head = n->next;
+		--s.count;
+		++s.retired_allocations;
+		return n;
+	}
+
+	static void shared_deallocate(void* p) noexcept {
+		shared& s = get_shared();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		free_node* n = static_cast<free_node*>(p);
+		n->next = s.head;
+		s.head = n;
+		++s.count;
+		++s.retired_deallocations;
+	}
+
+	static void refill(cache& c) {
+		shared& s = get_shared();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		if (s.head == nullptr)
+			grow(s);
+		const size_t want = cache_limit / 2;
+		while (s.head && c.count < want) {
+			free_node* n = s.head;
+			s.head = n->next;
+			--s.count;
+			n->next = c.head;
+			c.head = n;
+			++c.count;
+		}
+	}
+
+	static void spill(cache& c, size_t n) {
+		free_node* first = c.head;
+		free_node* last = first;
+		for (size_t i = 1; i < n; ++i)
+			last = last->next;
+		c.head = last->next;
+		c.count -= n;
+
+		shared& s = get_shared();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		last->next = s.head;
+		s.head = first;
+		s.count += n;
+	}
+};
+
+// ---------------------------
+// size classes
+// ---------------------------
+
+class size_class_pool
+{
+public:
+	static constexpr size_t min_class = 16;
+	static constexpr size_t max_class = 4096;
+
+	static void* allocate(size_t bytes) {
+		switch (class_index(bytes)) {
+		case 0: return fixed_block_pool<16>::allocate();
+		case 1: return fixed_block_pool<32>::allocate();
+		case 2: return fixed_block_pool<64>::allocate();
+		case 3: return fixed_block_pool<128>::allocate();
+		case 4: return fixed_block_pool<256>::allocate();
+		case 5: return fixed_block_pool<512>::allocate();
+		case 6: return fixed_block_pool<1024>::allocate();
+		case 7: return fixed_block_pool<2048>::allocate();
+		case 8: return fixed_block_pool<4096>::allocate();
+		default:
+			large().allocations.fetch_add(1, std::memory_order_relaxed);
+			large().bytes.fetch_add(bytes, std::memory_order_relaxed);
+			return ::operator new(bytes);
+		}
+	}
+
+	// bytes must be the size passed to allocate
+	static void deallocate(void* p, size_t bytes) noexcept {
+		switch (class_index(bytes)) {
+		case 0: fixed_block_pool<16>::deallocate(p); break;
+		case 1: fixed_block_pool<32>::deallocate(p); break;
+		case 2: fixed_block_pool<64>::deallocate(p); break;
+		case 3: fixed_block_pool<128>::deallocate(p); break;
+		case 4: fixed_block_pool<256>::deallocate(p); break;
+		case 5: fixed_block_pool<512>::deallocate(p); break;
+		case 6: fixed_block_pool<1024>::deallocate(p); break;
+		case 7: fixed_block_pool<2048>::deallocate(p); break;
+		case 8: fixed_block_pool<4096>::deallocate(p); break;
+		default:
+			large().deallocations.fetch_add(1, std::memory_order_relaxed);
+			large().bytes.fetch_sub(bytes, std::memory_order_relaxed);
+			::operator delete(p);
+			break;
+		}
+	}
+
+	// sum over every class. operator new fallbacks count as upstream allocations
+	static allocator_stats stats() {
+		const allocator_stats parts[] = {
+			fixed_block_pool<16>::stats(), fixed_block_pool<32>::stats(), fixed_block_pool<64>::stats(),
+			fixed_block_pool<128>::stats(), fixed_block_pool<256>::stats(), fixed_block_pool<512>::stats(),
+			fixed_block_pool<1024>::stats(), fixed_block_pool<2048>::stats(), fixed_block_pool<4096>::stats(),
+		};
+		allocator_stats ret = allocator_stats();
+		for (auto& p : parts) {
+			ret.allocations += p.allocations;
+			ret.deallocations += p.deallocations;
+			ret.bytes_in_use += p.bytes_in_use;
+			ret.bytes_reserved += p.bytes_reserved;
+			ret.upstream_allocations += p.upstream_allocations;
+		}
+		const uint64_t large_allocs = large().allocations.load(std::memory_order_relaxed);
+		const uint64_t large_bytes = large().bytes.load(std::memory_order_relaxed);
+		ret.allocations += large_allocs;
+		ret.deallocations += large().deallocations.load(std::memory_order_relaxed);
+		ret.bytes_in_use += large_bytes;
+		ret.bytes_reserved += large_bytes;
+		ret.upstream_allocations += large_allocs;
+		return ret;
+	}
+
+private:
+	struct large_stats {
+		std::atomic<uint64_t> allocations{ 0 };
+		std::atomic<uint64_t> deallocations{ 0 };
+		std::atomic<uint64_t> bytes{ 0 };
+	};
+
+	static large_stats& large() {
+		static large_stats s;
+		return s;
+	}
+
+	// 0 : 16 bytes ... 8 : 4096 bytes, 9 : operator new
+	static inline size_t class_index(size_t bytes) noexcept {
+		if (bytes > max_class)
+			return 9;
+		size_t idx = 0;
+		size_t cls = min_class;
+		while (cls < bytes) {
+			cls <<= 1;
+			++idx;
+		}
+		return idx;
+	}
+};
+
+// ---------------------------
+// monotonic arena
+// ---------------------------
+
+// not thread safe. one arena per thread / request / frame
+class monotonic_arena
+{
+public:
+	explicit monotonic_arena(size_t initial_chunk = 4096) : _next_chunk(initial_chunk < 64 ? 64 : initial_chunk) {}
+
+	~monotonic_arena() {
+		for (auto c : _chunks)
+			::operator delete(c.ptr);
+	}
+
+	monotonic_arena(const monotonic_arena&) = delete;
+	monotonic_arena& operator= (const monotonic_arena&) = delete;
+
+	void* allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+		assert((align & (align - 1)) == 0 && "alignment must be a power of two");
+		uintptr_t p = (_cur + align - 1) & ~(uintptr_t)(align - 1);
+		if (_cur == 0 || p + bytes > _end) {
+			grow(bytes + align);
+			p = (_cur + align - 1) & ~(uintptr_t)(align - 1);
+		}
+		_cur = p + bytes;
+		++_allocations;
+		_bytes_in_use += bytes;
+		return reinterpret_cast<void*>(p);
+	}
+
+	// memory comes back only with release()
+	void deallocate(void*, size_t) noexcept {
+		++_deallocations;
+	}
+
+	// drop every allocation at once. the largest chunk is kept for reuse
+	void release() noexcept {
+		if (_chunks.empty())
+			return;
+		chunk keep = _chunks.back();
+		for (size_t i = 0; i + 1 < _chunks.size(); ++i)
+			::operator delete(_chunks[i].ptr);
+		_chunks.clear();
+		_chunks.push_back(keep);
+		_reserved = keep.size;
+		_cur = reinterpret_cast<uintptr_t>(keep.ptr);
+		_end = _cur + keep.size;
+		_bytes_in_use = 0;
+	}
+
+	allocator_stats stats() const noexcept {
+		allocator_stats ret;
+		ret.allocations = _allocations;
+		ret.deallocations = _deallocations;
+		ret.bytes_in_use = _bytes_in_use;
+		ret.bytes_reserved = _reserved;
+		ret.upstream_allocations = _upstream_allocations;
+		return ret;
+	}
+
+private:
+	struct chunk {
+		void* ptr;
+		size_t size;
+	};
+
+	void grow(size_t min_bytes) {
+		size_t size = _next_chunk;
+		while (size < min_bytes)
+			size <<= 1;
+		void* ptr = ::operator new(size);
+		_chunks.push_back(chunk{ ptr, size });
+		_cur = reinterpret_cast<uintptr_t>(ptr);
+		_end = _cur + size;
+		_next_chunk = size * 2;
+		_reserved += size;
+		++_upstream_allocations;
+	}
+
+	std::vector<chunk> _chunks;
+	uintptr_t _cur{ 0 };
+	uintptr_t _end{ 0 };
+	size_t _next_chunk;
+	uint64_t _allocations{ 0 };
+	uint64_t _deallocations{ 0 };
+	uint64_t _bytes_in_use{ 0 };
+	uint64_t _reserved{ 0 };
+	uint64_t _upstream_allocations{ 0 };
+};
+
+// ---------------------------
+// STL allocators
+// ---------------------------
+
+// stateless, all instances are interchangeable
+template <class T>
+class pool_allocator
+{
+	static_assert(alignof(T) <= alignof(std::max_align_t), "pool_allocator does not support over aligned types");
+public:
+	typedef T value_type;
+
+	pool_allocator() noexcept = default;
+	template <class U>
+	pool_allocator(const pool_allocator<U>&) noexcept {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(size_class_pool::allocate(n * sizeof(T)));
+	}
+
+	void deallocate(T* p, size_t n) noexcept {
+		size_class_pool::deallocate(p, n * sizeof(T));
+	}
+
+	template <class U>
+	struct rebind {
+		typedef pool_allocator<U> other;
+	};
+};
+
+template <class T, class U>
+inline bool operator==(const pool_allocator<T>&, const pool_allocator<U>&) noexcept { return true; }
+template <class T, class U>
+inline bool operator!=(const pool_allocator<T>&, const pool_allocator<U>&) noexcept { return false; }
+
+// the arena must outlive every container using it
+template <class T>
+class arena_allocator
+{
+public:
+	typedef T value_type;
+
+	explicit arena_allocator(monotonic_arena& arena) noexcept : _arena(&arena) {}
+	template <class U>
+	arena_allocator(const arena_allocator<U>& other) noexcept : _arena(other.arena()) {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T* p, size_t n) noexcept {
+		_arena->deallocate(p, n * sizeof(T));
+	}
+
+	monotonic_arena* arena() const noexcept {
+		return _arena;
+	}
+
+	template <class U>
+	struct rebind {
+		typedef arena_allocator<U> other;
+	};
+
+private:
+	monotonic_arena* _arena;
+};
+
+template <class T, class U>
+inline bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b) noexcept { return a.arena() == b.arena(); }
+template <class T, class U>
+inline bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b) noexcept { return a.arena() != b.arena(); }
+
+#endif // !__POOL_ALLOCATOR_HPP__
@@ -0,0 +1,333 @@
+// revision 1.0 by luj
+// for cross platform
+
+// turns a PRINT_BINARY log (async_print.hpp) back into text.
+//	g++ -std=c++14 -O2 print_decoder.cpp -o print_decoder -pthread
+//	print_decoder [-t] [-c] log.bin		(no file : stdin)
+//		-t : prefix every line with its time (UTC)
+//		-c : strip the ANSI colors
+
+#define PRINT_BINARY 1
+#include "async_print.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct format_entry {
+	std::string func;
+	std::string fmt;
+	std::string types;
+};
+
+struct arg_value {
+	char kind;	// as in the types string, 'i' / 'u' / 'f' / 'p' / 's'
+	long long i;
+	unsigned long long u;
+	long double f;
+	std::string s;
+};
+
+class reader
+{
+public:
+	explicit reader(const std::vector<uint8_t>& data) : _data(data) {}
+
+	inline bool done() const { return _pos >= _data.size(); }
+
+	template <class Tp>
+	bool get(Tp& _Val) {
+		if (_pos + sizeof(Tp) > _data.size())
+			return false;
+		_Val = SerDesLittle::extract<Tp>(_data.data() + _pos);
+		_pos += sizeof(Tp);
+		return true;
+	}
+
+	bool get(std::string& _Val) {
+		uint32_t len;
+		if (!get(len) || _pos + len > _data.size())
+			return false;
+		_Val.assign((const char*)_data.data() + _pos, len);
+		_pos += len;
+		return true;
+	}
+
+	bool get_magic() {
+		if (_data.size() < async_print::binary_magic_size ||
+			memcmp(_data.data(), async_print::binary_magic, async_print::binary_magic_size) != 0)
+			return false;
+		_pos = async_print::binary_magic_size;
+		return true;
+	}
+
+	// return false : truncated or unknown type code
+	bool get_arg(char kind, char size, arg_value& v) {
+		v.kind = kind;
+		switch (kind) {
+		case 'i':
+			switch (size) {
+			case 1: { int8_t x; if (!get(x)) return false; v.i = x; return true; }
+			case 2: { int16_t x; if (!get(x)) return false; v.i = x; return true; }
+			case 4: { int32_t x; if (!get(x)) return false; v.i = x; return true; }
+			case 8: { int64_t x; if (!get(x)) return false; v.i = x; return true; }
+			}
+			return false;
+		case 'u':
+		case 'p':
+			switch (size) {
+			case 1: { uint8_t x; if (!get(x)) return false; v.u = x; return true; }
+			case 2: { uint16_t x; if (!get(x)) return false; v.u = x; return true; }
+			case 4: { uint32_t x; if (!get(x)) return false; v.u = x; return true; }
+			case 8: { uint64_t x; if (!get(x)) return false; v.u = x; return true; }
+			}
+			return false;
+		case 'f':
+			if (size == sizeof(float)) { float x; if (!get(x)) return false; v.f = x; return true; }
+			if (size == sizeof(double)) { double x; if (!get(x)) return false; v.f = x; return true; }
+			if (size == sizeof(long double)) { long double x; if (!get(x)) return false; v.f = x; return true; }
+			return false;
+		case 's':
+			return get(v.s);
+		}
+		return false;
+	}
+
+private:
+	const std::vector<uint8_t>& _data;
+	size_t _pos{ 0 };
+};
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+#endif
+
+// h / hh narrow the promoted int as printf does, the other length modifiers only name the stored size
+static long long narrow_signed(long long x, const std::string& length) {
+	if (length == "hh")
+		return (signed char)x;
+	if (length == "h")
+		return (short)x;
+	return x;
+}
+
+static unsigned long long narrow_unsigned(unsigned long long x, const std::string& length) {
+	if (length == "hh")
+		return (unsigned char)x;
+	if (length == "h")
+		return (unsigned short)x;
+	return x;
+}
+
+// one conversion. spec is the printf spec without length modifiers, length the modifiers
+// and conv the conversion character
+static void format_one(std::string& out, std::string spec, const std::string& length, char conv, const arg_value* v) {
+	char buf[512];
+	int n = -1;
+	if (v == nullptr) {
+		out += "<missing>";
+		return;
+	}
+	switch (conv) {
+	case 'd': case 'i':
+		spec += "ll";
+		spec += conv;
+		n = snprintf(buf, sizeof(buf), spec.c_str(), narrow_signed(v->kind == 'i' ? v->i : (long long)v->u, length));
+		break;
+	case 'o': case 'u': case 'x': case 'X':
+		spec += "ll";
+		spec += conv;
+		n = snprintf(buf, sizeof(buf), spec.c_str(), narrow_unsigned(v->kind == 'i' ? (unsigned long long)v->i : v->u, length));
+		break;
+	case 'c':
+		spec += conv;
+		n = snprintf(buf, sizeof(buf), spec.c_str(), (int)(v->kind == 'i' ? v->i : (long long)v->u));
+		break;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+		spec += 'L';
+		spec += conv;
+		n = snprintf(buf, sizeof(buf), spec.c_str(),
+			v->kind == 'f' ? v->f : v->kind == 'i' ? (long double)v->i : (long double)v->u);
+		break;
+	case 'p':
+		spec += conv;
+		n = snprintf(buf, sizeof(buf), spec.c_str(), (void*)(uintptr_t)v->u);
+		break;
+	case 's':
+		spec += conv;
+		if (v->kind == 's') {
+			std::vector<char> big(v->s.size() + 64 + spec.size());
+			n = snprintf(big.data(), big.size(), spec.c_str(), v->s.c_str());
+			if (n > 0)
+				out.append(big.data(), std::min((size_t)n, big.size() - 1));
+			return;
+		}
+		out += "<not a string>";
+		return;
+	default:
+		out += spec;
+		out += conv;
+		return;
+	}
+	if (n > 0)
+		out.append(buf, std::min((size_t)n, sizeof(buf) - 1));
+}
+
+// printf again, with the arguments taken from the record
+static void format_line(std::string& out, const std::string& fmt, const std::vector<arg_value>& args) {
+	size_t next = 0;
+	auto take = [&]() -> const arg_value* { return next < args.size() ? &args[next++] : nullptr; };
+	for (size_t i = 0; i < fmt.size(); ++i) {
+		if (fmt[i] != '%') {
+			out += fmt[i];
+			continue;
+		}
+		if (i + 1 < fmt.size() && fmt[i + 1] == '%') {
+			out += '%';
+			++i;
+			continue;
+		}
+		std::string spec = "%";
+		size_t j = i + 1;
+		// flags, width, precision. '*' takes an int argument
+		while (j < fmt.size() && strchr("-+ #0123456789.*", fmt[j])) {
+			if (fmt[j] == '*') {
+				const arg_value* w = take();
+				spec += std::to_string(w ? (w->kind == 'i' ? w->i : (long long)w->u) : 0);
+			}
+			else
+				spec += fmt[j];
+			++j;
+		}
+		// length modifiers. the stored type already has the size, only h / hh change the output
+		std::string length;
+		while (j < fmt.size() && strchr("hljztLq", fmt[j]))
+			length += fmt[j++];
+		if (j >= fmt.size()) {
+			out += spec;
+			break;
+		}
+		const char conv = fmt[j];
+		if (conv == 'n')
+			take();
+		else
+			format_one(out, spec, length, conv, take());
+		i = j;
+	}
+}
+
+static void strip_colors(std::string& s) {
+	std::string ret;
+	ret.reserve(s.size());
+	for (size_t i = 0; i < s.size(); ++i) {
+		if (s[i] == '\x1b' && i + 1 < s.size() && s[i + 1] == '[') {
+			size_t j = i + 2;
+			while (j < s.size() && !((s[j] >= 'A' && s[j] <= 'Z') || (s[j] >= 'a' && s[j] <= 'z')))
+				++j;
+			i = j;
+			continue;
+		}
+		ret += s[i];
+	}
+	s.swap(ret);
+}
+
+static void time_prefix(std::string& out, uint64_t ns) {
+	const time_t sec = (time_t)(ns / 1000000000ULL);
+	struct tm tm_buf;
+#ifdef _WIN32
+	gmtime_s(&tm_buf, &sec);
+#else
+	gmtime_r(&sec, &tm_buf);
+#endif
+	char buf[64];
+	const size_t n = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm_buf);
+	out.append(buf, n);
+	snprintf(buf, sizeof(buf), ".%09llu ", (unsigned long long)(ns % 1000000000ULL));
+	out += buf;
+}
+
+int main(int argc, char** argv) {
+	bool with_time = false;
+	bool no_color = false;
+	const char* path = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-t") == 0)
+			with_time = true;
+		else if (strcmp(argv[i], "-c") == 0)
+			no_color = true;
+		else
+			path = argv[i];
+	}
+
+	FILE* in = path ? fopen(path, "rb") : stdin;
+	if (in == nullptr) {
+		fprintf(stderr, "print_decoder : cannot open %s\n", path);
+		return 1;
+	}
+	std::vector<uint8_t> data;
+	uint8_t chunk[1 << 16];
+	size_t n;
+	while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0)
+		data.insert(data.end(), chunk, chunk + n);
+	if (in != stdin)
+		fclose(in);
+
+	reader r(data);
+	if (!r.get_magic()) {
+		fprintf(stderr, "print_decoder : not a PRINT_BINARY log\n");
+		return 1;
+	}
+
+	std::unordered_map<uint32_t, format_entry> formats;
+	std::vector<arg_value> args;
+	std::string line;
+	while (!r.done()) {
+		uint8_t tag;
+		uint32_t id;
+		if (!r.get(tag) || !r.get(id))
+			break;
+		if (tag == async_print::binary_tag_format) {
+			format_entry e;
+			if (!r.get(e.func) || !r.get(e.fmt) || !r.get(e.types))
+				break;
+			formats[id] = std::move(e);
+			continue;
+		}
+		if (tag != async_print::binary_tag_record) {
+			fprintf(stderr, "print_decoder : unknown tag %u\n", (unsigned)tag);
+			return 1;
+		}
+		uint64_t time;
+		auto it = formats.find(id);
+		if (!r.get(time) || it == formats.end()) {
+			if (it == formats.end())
+				fprintf(stderr, "print_decoder : record with unknown id %u\n", id);
+			return 1;
+		}
+		const format_entry& e = it->second;
+		args.resize(1 + e.types.size() / 2);
+		args[0].kind = 's';
+		args[0].s = e.func;
+		bool ok = true;
+		for (size_t k = 0; ok && k + 1 < e.types.size(); k += 2)
+			ok = r.get_arg(e.types[k], e.types[k + 1], args[1 + k / 2]);
+		if (!ok) {
+			fprintf(stderr, "print_decoder : truncated record\n");
+			return 1;
+		}
+
+		line.clear();
+		if (with_time)
+			time_prefix(line, time);
+		format_line(line, e.fmt, args);
+		if (no_color)
+			strip_colors(line);
+		fwrite(line.data(), 1, line.size(), stdout);
+	}
+	return 0;
+}
@@ -2,12 +2,60 @@
 #ifndef __PRINT_UTILS_H__
 #define __PRINT_UTILS_H__
 
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <type_traits>
 
 #define PRINT_FUNCTION              1
 #define DEBUG_LUJ                  0
+#ifndef PRINT_ASYNC
+#define PRINT_ASYNC                0	// 1 : format and write on a background thread (async_print.hpp)
+#endif
+#ifndef PRINT_BINARY
+#define PRINT_BINARY               0	// 1 : with PRINT_ASYNC, write a binary log for print_decoder
+#endif
+#ifndef PRINT_PREPARSE
+#define PRINT_PREPARSE             0	// 1 : (C++17) check and split formats at compile time
+#endif
+
+// levels. a level above PRINT_MODULE_LEVEL compiles to void(0) and does not evaluate its arguments.
+// define PRINT_MODULE_LEVEL before including this header to set it per translation unit.
+// print_set_level() lowers it at run time for every module (one relaxed load per call)
+#define PRINT_LEVEL_NONE           0
+#define PRINT_LEVEL_ERROR          1	// eprint
+#define PRINT_LEVEL_WARN           2	// wprint
+#define PRINT_LEVEL_INFO           3	// iprint
+#define PRINT_LEVEL_DEBUG          4	// dprint
+#ifndef PRINT_MODULE_LEVEL
+#if DEBUG_LUJ
+#define PRINT_MODULE_LEVEL         PRINT_LEVEL_DEBUG
+#else
+#define PRINT_MODULE_LEVEL         PRINT_LEVEL_INFO
+#endif
+#endif
 
 #if PRINT_FUNCTION
 
+#if PRINT_ASYNC
+#include "async_print.hpp"
+#if PRINT_PREPARSE
+// printf in sizeof keeps the compiler's format checks and is never called
+#define PRINT_IMPL(fmt, ...) ((void)sizeof(printf(fmt, __VA_ARGS__)), print_async([]() { return fmt; }, __VA_ARGS__))
+#else
+#define PRINT_IMPL(...) ((void)sizeof(printf(__VA_ARGS__)), async_print::log(__VA_ARGS__))
+#endif
+#else // ~PRINT_ASYNC
+#if PRINT_PREPARSE
+#define PRINT_IMPL(fmt, ...) ((void)sizeof(printf(fmt, __VA_ARGS__)), print_preparsed([]() { return fmt; }, __VA_ARGS__))
+#else
+#define PRINT_IMPL printf
+#endif
+#endif // ~PRINT_ASYNC
+
+#define PRINT_IF(level, call) (print_level_enabled(level) ? (void)(call) : (void)0)
+
 //-Wno-variadic-macros
 #define ANSI_COLOR_RED     "\x1b[31m"
 #define ANSI_COLOR_GREEN   "\x1b[32m"
@@ -17,57 +65,81 @@
 #define ANSI_COLOR_CYAN    "\x1b[36m"
 #define ANSI_COLOR_RESET   "\x1b[0m"
 #ifdef _WIN32 // for embeded
-#if DEBUG_LUJ
+#if PRINT_MODULE_LEVEL >= PRINT_LEVEL_DEBUG
 #if 0 // filename print
 #define dprint(fmt, arg...)  \
-                printf("<%s:%u>: " ANSI_COLOR_YELLOW fmt ANSI_COLOR_RESET, \
-                __FILE__, __LINE__, __VA_ARGS__)
+                PRINT_IF(PRINT_LEVEL_DEBUG, PRINT_IMPL("<%s:%u>: " ANSI_COLOR_YELLOW fmt ANSI_COLOR_RESET, \
+                __FILE__, __LINE__, __VA_ARGS__))
 #else // small print
 #define dprint(fmt, ...)  \
-                printf("<%s>: " ANSI_COLOR_YELLOW fmt ANSI_COLOR_RESET, \
-                __FUNCTION__, __VA_ARGS__)
+                PRINT_IF(PRINT_LEVEL_DEBUG, PRINT_IMPL("<%s>: " ANSI_COLOR_YELLOW fmt ANSI_COLOR_RESET, \
+                __FUNCTION__, __VA_ARGS__))
 #endif
-#else // ~DEBUG_LUJ
+#else // ~PRINT_LEVEL_DEBUG
 #define dprint(fmt, ...) void(0)
-#endif // ~DEBUG_LUJ
+#endif // ~PRINT_LEVEL_DEBUG
 
+#if PRINT_MODULE_LEVEL >= PRINT_LEVEL_ERROR
 #define eprint(fmt, ...)  \
-            printf("<%s>: " ANSI_COLOR_RED fmt ANSI_COLOR_RESET, \
-            __FUNCTION__, __VA_ARGS__)
+            PRINT_IF(PRINT_LEVEL_ERROR, PRINT_IMPL("<%s>: " ANSI_COLOR_RED fmt ANSI_COLOR_RESET, \
+            __FUNCTION__, __VA_ARGS__))
+#else
+#define eprint(fmt, ...) void(0)
+#endif
 
+#if PRINT_MODULE_LEVEL >= PRINT_LEVEL_WARN
 #define wprint(fmt, ...)  \
-            printf("<%s>: " ANSI_COLOR_MAGENTA fmt ANSI_COLOR_RESET, \
-            __FUNCTION__, __VA_ARGS__)
+            PRINT_IF(PRINT_LEVEL_WARN, PRINT_IMPL("<%s>: " ANSI_COLOR_MAGENTA fmt ANSI_COLOR_RESET, \
+            __FUNCTION__, __VA_ARGS__))
+#else
+#define wprint(fmt, ...) void(0)
+#endif
 
+#if PRINT_MODULE_LEVEL >= PRINT_LEVEL_INFO
 #define iprint(fmt, ...)  \
-            printf("<%s>: " ANSI_COLOR_GREEN fmt ANSI_COLOR_RESET, \
-            __FUNCTION__, __VA_ARGS__)
+            PRINT_IF(PRINT_LEVEL_INFO, PRINT_IMPL("<%s>: " ANSI_COLOR_GREEN fmt ANSI_COLOR_RESET, \
+            __FUNCTION__, __VA_ARGS__))
+#else
+#define iprint(fmt, ...) void(0)
+#endif
 #else // _WIN32 // for pc
-#if DEBUG_LUJ
+#if PRINT_MODULE_LEVEL >= PRINT_LEVEL_DEBUG
 #if 0 // filename print
 #define dprint(fmt, arg...)  \
-                printf("<%s:%u>: " ANSI_COLOR_YELLOW fmt ANSI_COLOR_RESET, \
-                __FILE__, __LINE__, ##__VA_ARGS__)
+                PRINT_IF(PRINT_LEVEL_DEBUG, PRINT_IMPL("<%s:%u>: " ANSI_COLOR_YELLOW fmt ANSI_COLOR_RESET, \
+                __FILE__, __LINE__, ##__VA_ARGS__))
 #else // small print
 #define dprint(fmt, ...)  \
-                printf("<%s>: " ANSI_COLOR_YELLOW fmt ANSI_COLOR_RESET, \
-                __FUNCTION__, ##__VA_ARGS__)
+                PRINT_IF(PRINT_LEVEL_DEBUG, PRINT_IMPL("<%s>: " ANSI_COLOR_YELLOW fmt ANSI_COLOR_RESET, \
+                __FUNCTION__, ##__VA_ARGS__))
 #endif
-#else // ~DEBUG_LUJ
+#else // ~PRINT_LEVEL_DEBUG
 #define dprint(fmt, ...) void(0)
-#endif // ~DEBUG_LUJ
+#endif // ~PRINT_LEVEL_DEBUG
 
+#if PRINT_MODULE_LEVEL >= PRINT_LEVEL_ERROR
 #define eprint(fmt, ...)  \
-            printf("<%s>: " ANSI_COLOR_RED fmt ANSI_COLOR_RESET, \
-            __FUNCTION__, ##__VA_ARGS__)
+            PRINT_IF(PRINT_LEVEL_ERROR, PRINT_IMPL("<%s>: " ANSI_COLOR_RED fmt ANSI_COLOR_RESET, \
+            __FUNCTION__, ##__VA_ARGS__))
+#else
+#define eprint(fmt, ...) void(0)
+#endif
 
+#if PRINT_MODULE_LEVEL >= PRINT_LEVEL_WARN
 #define wprint(fmt, ...)  \
-            printf("<%s>: " ANSI_COLOR_MAGENTA fmt ANSI_COLOR_RESET, \
-            __FUNCTION__, ##__VA_ARGS__)
+            PRINT_IF(PRINT_LEVEL_WARN, PRINT_IMPL("<%s>: " ANSI_COLOR_MAGENTA fmt ANSI_COLOR_RESET, \
+            __FUNCTION__, ##__VA_ARGS__))
+#else
+#define wprint(fmt, ...) void(0)
+#endif
 
+#if PRINT_MODULE_LEVEL >= PRINT_LEVEL_INFO
 #define iprint(fmt, ...)  \
-            printf("<%s>: " ANSI_COLOR_GREEN fmt ANSI_COLOR_RESET, \
-            __FUNCTION__, ##__VA_ARGS__)
+            PRINT_IF(PRINT_LEVEL_INFO, PRINT_IMPL("<%s>: " ANSI_COLOR_GREEN fmt ANSI_COLOR_RESET, \
+            __FUNCTION__, ##__VA_ARGS__))
+#else
+#define iprint(fmt, ...) void(0)
+#endif
 #endif
 
 #else // ~PRINT_FUNCTION
@@ -90,5 +162,445 @@ constexpr bool static_string_find(char const* buffer, char const* search) {
 	return false;
 }
 
-#endif // !__PRINT_UTILS_H__
+constexpr bool static_char_find(char const* buffer, char c) {
+	while (*buffer)
+	{
+		if (*buffer++ == c)
+			return true;
+	}
+	return false;
+}
+
+// run time level, constant initialized so the check is a plain relaxed load
+template <class = void>
+struct print_level_holder {
+	static std::atomic<int> level;
+};
+template <class T> std::atomic<int> print_level_holder<T>::level{ PRINT_LEVEL_DEBUG };
+
+inline bool print_level_enabled(int level) {
+	return level <= print_level_holder<>::level.load(std::memory_order_relaxed);
+}
+
+// levels above PRINT_MODULE_LEVEL stay compiled out whatever is set here
+inline void print_set_level(int level) {
+	print_level_holder<>::level.store(level, std::memory_order_relaxed);
+}
+
+inline int print_get_level() {
+	return print_level_holder<>::level.load(std::memory_order_relaxed);
+}
+
+#if PRINT_PREPARSE
+
+#if __cplusplus < 201703L
+#error "PRINT_PREPARSE requires C++17"
+#endif
+
+//--------------------------------------------------------------------------------------------------
+// Compile time format parsing (C++17)
+//	the format literal is split into pieces : literal text, then one conversion (or none for "%%").
+//	argument count and kinds are checked with static_assert, so a bad call does not build.
+//	plain %d %i %u %x %c %s (l / ll / z / j / t allowed) are converted without snprintf;
+//	any other conversion runs snprintf on its own spec only. formats with '*' fall back to printf
+//--------------------------------------------------------------------------------------------------
 
+enum print_arg_kind : char {
+	print_kind_none = 0,	// "%%"
+	print_kind_integer,
+	print_kind_floating,
+	print_kind_string,
+	print_kind_pointer,
+};
+
+struct print_piece {
+	unsigned literal_begin;
+	unsigned literal_end;
+	unsigned spec_begin;	// "%...conv"
+	unsigned spec_end;
+	char conv;				// 0 : literal only
+	print_arg_kind kind;
+	bool simple;			// no flags / width / precision / h / hh / L
+};
+
+enum print_format_error {
+	print_format_ok = 0,
+	print_format_truncated,		// ends inside a conversion
+	print_format_unknown,		// unknown conversion character
+	print_format_n,				// %n is not supported
+};
+
+template <size_t N>
+struct print_format_desc {
+	print_piece pieces[N];
+	size_t count;		// pieces used
+	size_t args;		// conversions that take an argument
+	print_format_error error;
+};
+
+constexpr size_t print_count_pieces(const char* fmt) {
+	size_t ret = 1;
+	for (size_t i = 0; fmt[i]; ++i) {
+		if (fmt[i] == '%') {
+			++ret;
+			if (fmt[i + 1] == '\0')
+				break;
+			++i;
+		}
+	}
+	return ret;
+}
+
+constexpr bool print_is_flag(char c) {
+	return c == '-' || c == '+' || c == ' ' || c == '#' || c == '.' || c == '*' || (c >= '0' && c <= '9');
+}
+
+constexpr print_arg_kind print_conv_kind(char c) {
+	switch (c) {
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+		return print_kind_integer;
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+		return print_kind_floating;
+	case 's':
+		return print_kind_string;
+	case 'p':
+		return print_kind_pointer;
+	default:
+		return print_kind_none;
+	}
+}
+
+template <size_t N>
+constexpr print_format_desc<N> print_parse(const char* fmt) {
+	print_format_desc<N> d{};
+	unsigned literal = 0;
+	unsigned i = 0;
+	while (fmt[i]) {
+		if (fmt[i] != '%') {
+			++i;
+			continue;
+		}
+		print_piece& p = d.pieces[d.count++];
+		p.literal_begin = literal;
+		p.spec_begin = i;
+		if (fmt[i + 1] == '%') {
+			// keep the first '%' as literal text, drop the second
+			p.literal_end = i + 1;
+			p.spec_end = i + 1;
+			literal = i + 2;
+			i += 2;
+			continue;
+		}
+		p.literal_end = i;
+		unsigned j = i + 1;
+		bool plain = true;
+		while (fmt[j] && print_is_flag(fmt[j])) {
+			plain = false;
+			++j;
+		}
+		bool short_length = false;
+		while (fmt[j] == 'l' || fmt[j] == 'z' || fmt[j] == 'j' || fmt[j] == 't' || fmt[j] == 'h' || fmt[j] == 'L' || fmt[j] == 'q') {
+			if (fmt[j] == 'h' || fmt[j] == 'L' || fmt[j] == 'q')
+				short_length = true;
+			++j;
+		}
+		if (fmt[j] == '\0') {
+			d.error = print_format_truncated;
+			return d;
+		}
+		if (fmt[j] == 'n') {
+			d.error = print_format_n;
+			return d;
+		}
+		p.conv = fmt[j];
+		p.kind = print_conv_kind(fmt[j]);
+		if (p.kind == print_kind_none) {
+			d.error = print_format_unknown;
+			return d;
+		}
+		p.simple = plain && !short_length &&
+			(p.conv == 'd' || p.conv == 'i' || p.conv == 'u' || p.conv == 'x' || p.conv == 'c' || p.conv == 's');
+		p.spec_end = j + 1;
+		++d.args;
+		literal = j + 1;
+		i = j + 1;
+	}
+	print_piece& tail = d.pieces[d.count++];
+	tail.literal_begin = literal;
+	tail.literal_end = i;
+	return d;
+}
+
+// what printf accepts for each kind
+template <class Arg>
+constexpr print_arg_kind print_kind_of() {
+	using A = std::decay_t<Arg>;
+	if constexpr (std::is_integral<A>::value || std::is_enum<A>::value)
+		return print_kind_integer;
+	else if constexpr (std::is_floating_point<A>::value)
+		return print_kind_floating;
+	else if constexpr (std::is_same<std::remove_cv_t<std::remove_pointer_t<A>>, char>::value && std::is_pointer<A>::value)
+		return print_kind_string;
+	else if constexpr (std::is_pointer<A>::value || std::is_null_pointer<A>::value)
+		return print_kind_pointer;
+	else
+		return print_kind_none;
+}
+
+// 0 : ok, otherwise 1 + index of the first argument that does not fit its conversion
+template <size_t N, size_t M>
+constexpr size_t print_check_kinds(const print_format_desc<N>& d, const print_arg_kind (&kinds)[M]) {
+	size_t arg = 0;
+	for (size_t i = 0; i < d.count; ++i) {
+		const print_piece& p = d.pieces[i];
+		if (p.conv == 0)
+			continue;
+		if (arg + 1 >= M)
+			return arg + 1;		// count mismatch, reported by its own static_assert
+		const print_arg_kind k = kinds[arg++];
+		const bool ok = k == p.kind ||
+			(p.kind == print_kind_pointer && k == print_kind_string);	// %p with char*
+		if (!ok)
+			return arg;
+	}
+	return 0;
+}
+
+// static_assert on the format. F : lambda returning the format literal
+template <class F, class... Args>
+constexpr void print_check_format(F f) {
+	constexpr const char* fmt = f();
+	constexpr size_t pieces = print_count_pieces(fmt);
+	constexpr print_format_desc<pieces> d = print_parse<pieces>(fmt);
+	static_assert(d.error != print_format_truncated, "print format ends inside a conversion");
+	static_assert(d.error != print_format_unknown, "print format has an unknown conversion");
+	static_assert(d.error != print_format_n, "print format : %n is not supported");
+	if constexpr (!static_char_find(fmt, '*') && d.error == print_format_ok) {
+		static_assert(d.args == sizeof...(Args), "print format : argument count does not match the conversions");
+		constexpr print_arg_kind kinds[sizeof...(Args) + 1] = { print_kind_of<Args>()..., print_kind_none };
+		static_assert(print_check_kinds(d, kinds) == 0, "print format : argument type does not match its conversion");
+	}
+}
+
+// type printf sees after default promotion (enums as their underlying type)
+template <class A, bool = std::is_enum<A>::value>
+struct print_promoted {
+	typedef decltype(+std::declval<A>()) type;
+};
+template <class A>
+struct print_promoted<A, true> {
+	typedef decltype(+std::declval<std::underlying_type_t<A>>()) type;
+};
+
+template <class A>
+inline auto print_vararg(const A& _Val) {
+	if constexpr (std::is_enum<A>::value)
+		return (std::underlying_type_t<A>)_Val;
+	else
+		return _Val;
+}
+
+// output of one call. stack buffer with a heap fallback, no thread_local state,
+// so prints from static destructors and exiting threads stay valid
+class print_out
+{
+public:
+	print_out() = default;
+	print_out(const print_out&) = delete;
+	print_out& operator= (const print_out&) = delete;
+
+	~print_out() {
+		if (_data != _local)
+			delete[] _data;
+	}
+
+	// return room for n more characters at the end
+	char* extend(size_t n) {
+		if (_size + n > _cap)
+			grow(_size + n);
+		char* p = _data + _size;
+		_size += n;
+		return p;
+	}
+
+	// keep the first n characters
+	void truncate(size_t n) noexcept {
+		if (n < _size)
+			_size = n;
+	}
+
+	void append(const char* s, size_t n) {
+		memcpy(extend(n), s, n);
+	}
+
+	print_out& operator+= (char c) {
+		*extend(1) = c;
+		return *this;
+	}
+
+	print_out& operator+= (const char* s) {
+		append(s, strlen(s));
+		return *this;
+	}
+
+	const char* data() const noexcept {
+		return _data;
+	}
+
+	size_t size() const noexcept {
+		return _size;
+	}
+
+private:
+	void grow(size_t need) {
+		size_t cap = _cap * 2;
+		while (cap < need)
+			cap *= 2;
+		char* p = new char[cap];
+		memcpy(p, _data, _size);
+		if (_data != _local)
+			delete[] _data;
+		_data = p;
+		_cap = cap;
+	}
+
+	char _local[256];
+	char* _data{ _local };
+	size_t _cap{ sizeof(_local) };
+	size_t _size{ 0 };
+};
+
+template <class T>
+inline void print_unsigned(print_out& out, T v, unsigned base) {
+	char buf[24];
+	char* p = buf + sizeof(buf);
+	do {
+		const unsigned digit = (unsigned)(v % base);
+		*--p = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+		v /= base;
+	} while (v);
+	out.append(p, buf + sizeof(buf) - p);
+}
+
+// one conversion. printf promotes the argument the same way
+template <class Arg>
+inline void print_convert(print_out& out, const char* fmt, const print_piece& p, const Arg& _Val) {
+	using A = std::decay_t<Arg>;
+	if constexpr (print_kind_of<A>() == print_kind_integer) {
+		if (p.simple) {
+			typedef typename print_promoted<A>::type P;
+			const P v = (P)_Val;
+			if (p.conv == 'c') {
+				out += (char)v;
+			}
+			else if (p.conv == 'd' || p.conv == 'i') {
+				const std::make_signed_t<P> s = (std::make_signed_t<P>)v;
+				if (s < 0) {
+					out += '-';
+					print_unsigned(out, (std::make_unsigned_t<P>)(0 - (std::make_unsigned_t<P>)s), 10);
+				}
+				else
+					print_unsigned(out, (std::make_unsigned_t<P>)s, 10);
+			}
+			else {
+				print_unsigned(out, (std::make_unsigned_t<P>)v, p.conv == 'x' ? 16 : 10);
+			}
+			return;
+		}
+	}
+	else if constexpr (print_kind_of<A>() == print_kind_string) {
+		if (p.simple) {
+			const char* str = _Val;
+			out += str ? str : "(null)";
+			return;
+		}
+	}
+	char spec[32];
+	const size_t len = p.spec_end - p.spec_begin;
+	std::string long_spec;
+	const char* s = spec;
+	if (len < sizeof(spec)) {
+		memcpy(spec, fmt + p.spec_begin, len);
+		spec[len] = '\0';
+	}
+	else {
+		long_spec.assign(fmt + p.spec_begin, len);
+		s = long_spec.c_str();
+	}
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+#endif
+	char buf[128];
+	const int n = snprintf(buf, sizeof(buf), s, print_vararg(_Val));
+	if (n < 0)
+		return;
+	if ((size_t)n < sizeof(buf)) {
+		out.append(buf, n);
+		return;
+	}
+	const size_t at = out.size();
+	snprintf(out.extend(n + 1), n + 1, s, print_vararg(_Val));
+	out.truncate(at + n);
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+}
+
+// fill the pre-parsed format into out
+template <class F, class... Args>
+inline void print_format_to(print_out& out, F f, const Args&... args) {
+	print_check_format<F, Args...>(f);
+	constexpr const char* fmt = f();
+	constexpr size_t pieces = print_count_pieces(fmt);
+	constexpr print_format_desc<pieces> d = print_parse<pieces>(fmt);
+	size_t i = 0;
+	auto put = [&](const auto& _Val) {
+		while (d.pieces[i].conv == 0) {
+			out.append(fmt + d.pieces[i].literal_begin, d.pieces[i].literal_end - d.pieces[i].literal_begin);
+			++i;
+		}
+		const print_piece& p = d.pieces[i++];
+		out.append(fmt + p.literal_begin, p.literal_end - p.literal_begin);
+		print_convert(out, fmt, p, _Val);
+	};
+	(put(args), ...);
+	for (; i < d.count; ++i)
+		out.append(fmt + d.pieces[i].literal_begin, d.pieces[i].literal_end - d.pieces[i].literal_begin);
+}
+
+// printf replacement used by the macros. return the number of characters written, like printf
+template <class F, class... Args>
+inline int print_preparsed(F f, const Args&... args) {
+	constexpr const char* fmt = f();
+	if constexpr (static_char_find(fmt, '*')) {
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+#endif
+		return printf(fmt, args...);
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+	}
+	else {
+		print_out out;
+		print_format_to(out, f, args...);
+		return (int)fwrite(out.data(), 1, out.size(), stdout);
+	}
+}
+
+#if PRINT_ASYNC
+// the async backend formats on its own thread; the caller only gets the compile time checks
+template <class F, class... Args>
+inline void print_async(F f, const char* func, const Args&... args) {
+	print_check_format<F, const char*, Args...>(f);
+	async_print::log(f(), func, args...);
+}
+#endif
+
+#endif // PRINT_PREPARSE
+
+#endif // !__PRINT_UTILS_H__
@@ -0,0 +1,83 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __RING_ITERATOR_HPP__
+#define __RING_ITERATOR_HPP__
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+// random access iterator over the logical contents of a ring (front to back).
+// Ring must provide operator[](size_t) indexed from the front
+template <class Ring, class V>
+class ring_iterator
+{
+public:
+	typedef std::random_access_iterator_tag iterator_category;
+	typedef typename std::remove_const<V>::type value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef V* pointer;
+	typedef V& reference;
+
+	ring_iterator() = default;
+	ring_iterator(Ring* ring, size_t pos) : _ring(ring), _pos(pos) {}
+
+	// iterator -> const_iterator
+	template <class R2, class V2, typename std::enable_if<std::is_convertible<V2*, V*>::value, int>::type = 0>
+	ring_iterator(const ring_iterator<R2, V2>& other) : _ring(other._ring), _pos(other._pos) {}
+
+	reference operator*() const { return (*_ring)[_pos]; }
+	pointer operator->() const { return &(*_ring)[_pos]; }
+	reference operator[](difference_type n) const { return (*_ring)[_pos + n]; }
+
+	ring_iterator& operator++() { ++_pos; return *this; }
+	ring_iterator& operator--() { --_pos; return *this; }
+	ring_iterator operator++(int) { ring_iterator tmp(*this); ++_pos; return tmp; }
+	ring_iterator operator--(int) { ring_iterator tmp(*this); --_pos; return tmp; }
+	ring_iterator& operator+=(difference_type n) { _pos += n; return *this; }
+	ring_iterator& operator-=(difference_type n) { _pos -= n; return *this; }
+
+	friend ring_iterator operator+(ring_iterator it, difference_type n) { return it += n; }
+	friend ring_iterator operator+(difference_type n, ring_iterator it) { return it += n; }
+	friend ring_iterator operator-(ring_iterator it, difference_type n) { return it -= n; }
+	friend difference_type operator-(const ring_iterator& a, const ring_iterator& b) {
+		return (difference_type)a._pos - (difference_type)b._pos;
+	}
+
+	friend bool operator==(const ring_iterator& a, const ring_iterator& b) { return a._pos == b._pos; }
+	friend bool operator!=(const ring_iterator& a, const ring_iterator& b) { return a._pos != b._pos; }
+	friend bool operator<(const ring_iterator& a, const ring_iterator& b) { return a._pos < b._pos; }
+	friend bool operator>(const ring_iterator& a, const ring_iterator& b) { return a._pos > b._pos; }
+	friend bool operator<=(const ring_iterator& a, const ring_iterator& b) { return a._pos <= b._pos; }
+	friend bool operator>=(const ring_iterator& a, const ring_iterator& b) { return a._pos >= b._pos; }
+
+private:
+	template <class R2, class V2> friend class ring_iterator;
+
+	Ring* _ring{ nullptr };
+	size_t _pos{ 0 };
+};
+
+// one contiguous segment of a ring
+template <class T>
+struct ring_span
+{
+	T* ptr{ nullptr };
+	size_t len{ 0 };
+
+	T* data() const noexcept { return ptr; }
+	size_t size() const noexcept { return len; }
+	bool empty() const noexcept { return len == 0; }
+	T* begin() const noexcept { return ptr; }
+	T* end() const noexcept { return ptr + len; }
+	T& operator[](size_t i) const noexcept { return ptr[i]; }
+};
+
+// the contents of a ring as (at most) two contiguous segments, front part first
+template <class T>
+using ring_spans = std::pair<ring_span<T>, ring_span<T>>;
+
+#endif // !__RING_ITERATOR_HPP__
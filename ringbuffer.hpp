@@ -12,16 +12,170 @@
 #include <iterator>
 #include <chrono>
 #include <memory>
+#include <algorithm>
+#include <functional>
+#include <utility>
 #include "assert.h"
+#include "ring_iterator.hpp"
 
-template <class T, size_t _Size, bool use_sum = false>
+// O(1) sliding window statistics for ringbuffer<T, _Size, use_sum, use_stat>
+// mean / variance are kept with Welford add & remove, min / max with monotonic deques
+template <class T, size_t _Size>
+class ringbuffer_stat
+{
+public:
+	void add(const T& _Val) {
+		const size_t seq = _back_seq++;
+		const double n = (double)(_back_seq - _front_seq);
+		const double delta = (double)_Val - _mean;
+		_mean += delta / n;
+		_m2 += delta * ((double)_Val - _mean);
+		_min_q.push(_Val, seq);
+		_max_q.push(_Val, seq);
+	}
+
+	void remove(const T& _Val) {
+		const size_t seq = _front_seq++;
+		const size_t n = _back_seq - _front_seq;
+		if (n == 0) {
+			_mean = 0;
+			_m2 = 0;
+		}
+		else {
+			const double delta = (double)_Val - _mean;
+			_mean -= delta / (double)n;
+			_m2 -= delta * ((double)_Val - _mean);
+			if (_m2 < 0)
+				_m2 = 0;
+		}
+		_min_q.evict(seq);
+		_max_q.evict(seq);
+	}
+
+	void clear() {
+		_front_seq = _back_seq = 0;
+		_mean = _m2 = 0;
+		_min_q.clear();
+		_max_q.clear();
+	}
+
+	// recompute mean / variance from the (at most two) contiguous segments of the window
+	void resync(const T* p0, size_t n0, const T* p1, size_t n1) {
+		const size_t n = n0 + n1;
+		if (n == 0) {
+			_mean = _m2 = 0;
+			return;
+		}
+		_mean = (reduce<double>(p0, n0, 0.0) + reduce<double>(p1, n1, 0.0)) / (double)n;
+		_m2 = reduce<double>(p0, n0, _mean, true) + reduce<double>(p1, n1, _mean, true);
+	}
+
+	// rebuild everything, including min / max, from the window contents
+	void rebuild(const T* p0, size_t n0, const T* p1, size_t n1) {
+		clear();
+		for (size_t i = 0; i < n0; ++i)
+			add(p0[i]);
+		for (size_t i = 0; i < n1; ++i)
+			add(p1[i]);
+	}
+
+	// sum (or sum of squared deviation from center) over a contiguous range.
+	// four independent accumulators keep the loop free of a serial dependency, so it vectorizes
+	template <class Acc>
+	static Acc reduce(const T* p, size_t n, Acc center, bool squared = false) {
+		Acc acc[4] = { 0, 0, 0, 0 };
+		size_t i = 0;
+		if (squared) {
+			for (; i + 4 <= n; i += 4) {
+				for (size_t lane = 0; lane < 4; ++lane) {
+					const Acc d = (Acc)p[i + lane] - center;
+					acc[lane] += d * d;
+				}
+			}
+			for (; i < n; ++i) {
+				const Acc d = (Acc)p[i] - center;
+				acc[0] += d * d;
+			}
+		}
+		else {
+			for (; i + 4 <= n; i += 4) {
+				for (size_t lane = 0; lane < 4; ++lane)
+					acc[lane] += (Acc)p[i + lane];
+			}
+			for (; i < n; ++i)
+				acc[0] += (Acc)p[i];
+		}
+		return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+	}
+
+	double mean() const {
+		return _mean;
+	}
+
+	// population variance of the window
+	double variance() const {
+		const size_t n = _back_seq - _front_seq;
+		return n ? _m2 / (double)n : 0;
+	}
+
+	const T& min() const {
+		return _min_q.top();
+	}
+
+	const T& max() const {
+		return _max_q.top();
+	}
+
+private:
+	// keeps (value, seq) pairs ordered by Cmp. the front is the extreme of the window
+	template <class Cmp>
+	struct mono_deque {
+		void push(const T& _Val, size_t seq) {
+			while (tail != head && !Cmp()(buf[(tail - 1) % _Size].first, _Val))
+				--tail;
+			buf[tail++ % _Size] = std::make_pair(_Val, seq);
+		}
+
+		void evict(size_t seq) {
+			if (head != tail && buf[head % _Size].second == seq)
+				++head;
+		}
+
+		const T& top() const {
+			assert(head != tail && "empty window");
+			return buf[head % _Size].first;
+		}
+
+		void clear() {
+			head = tail = 0;
+		}
+
+		std::array<std::pair<T, size_t>, _Size> buf;
+		size_t head{ 0 };
+		size_t tail{ 0 };
+	};
+
+	size_t _front_seq{ 0 };
+	size_t _back_seq{ 0 };
+	double _mean{ 0 };
+	double _m2{ 0 };
+	mono_deque<std::less<T>> _min_q;
+	mono_deque<std::greater<T>> _max_q;
+};
+
+struct ringbuffer_no_stat {};
+
+template <class T, size_t _Size, bool use_sum = false, bool use_stat = false>
 class ringbuffer :
 	protected std::array<T, _Size>
 {
 private:
 	static constexpr bool sum_en = !std::is_pointer<T>::value && use_sum;
+	static constexpr bool stat_en = std::is_arithmetic<T>::value && use_stat;
 	typedef std::array<T, _Size> _Arr;
 public:
+	typedef ring_iterator<ringbuffer, T> iterator;
+	typedef ring_iterator<const ringbuffer, const T> const_iterator;
 
 #if __cplusplus > 201402L && (defined(__GNUC__) ? __GNUC__ > 6 : true)
 	//if you want this code in MSVC, add this C++ Commandline Option [ /Zc:__cplusplus /std:c++17 ]
@@ -53,6 +207,7 @@ private:
 public:
 #endif
 
+	// allocates a shared_ptr control block per call. hot paths should use object_pool<T> (object_pool.hpp)
 	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
 	auto pull_front_auto_recycle() {
 		using T_nptr = typename std::remove_pointer<T>::type;
@@ -98,6 +253,52 @@ public:
 		return true;
 	}
 
+	// zero copy producer side. write in place, then publish with commit()
+	// return nullptr : buffer is full
+	T* reserve() {
+		return full() ? nullptr : &*back_it;
+	}
+
+	// return count of contiguous writable slots from ptr (at most n)
+	size_t reserve(T*& ptr, size_t n) {
+		ptr = &*back_it;
+		return std::min({ n, capacity() - _size, (size_t)(_Arr::end() - back_it) });
+	}
+
+	// publish n slots written through reserve()
+	void commit(size_t n = 1) {
+		assert(n <= capacity() - _size && "ringbuffer overrun");
+		for (size_t i = 0; i < n; ++i) {
+			_on_push(*back_it);
+			if (++back_it == _Arr::end())
+				back_it = _Arr::begin();
+		}
+		_size += n;
+	}
+
+	// zero copy consumer side. read in place, then free with release()
+	// return nullptr : buffer is empty
+	T* peek() {
+		return _empty() ? nullptr : &*front_it;
+	}
+
+	// return count of contiguous readable slots from ptr (at most n)
+	size_t peek(T*& ptr, size_t n) {
+		ptr = &*front_it;
+		return std::min({ n, _size, (size_t)(_Arr::end() - front_it) });
+	}
+
+	// free n slots read through peek()
+	void release(size_t n = 1) {
+		assert(n <= _size && "ringbuffer underrun");
+		for (size_t i = 0; i < n; ++i) {
+			_on_pull(*front_it);
+			if (++front_it == _Arr::end())
+				front_it = _Arr::begin();
+		}
+		_size -= n;
+	}
+
 	auto empty() {
 		return _size == 0;
 	}
@@ -110,10 +311,13 @@ public:
 		return _size;
 	}
 
+	// overwrites every slot, size() is unchanged. sum / stat cover the size() live elements
 	void fill(const T& _Val) {
 		_Arr::fill(_Val);
 		if constexpr (sum_en)
-			_sum = _Val * _Size;
+			_sum = _Val * (T)_size;
+		if constexpr (stat_en)
+			_stat_rebuild();
 	}
 
 	void clear() {
@@ -122,18 +326,37 @@ public:
 		_size = 0;
 		if constexpr (sum_en)
 			_sum = 0;
+		if constexpr (stat_en)
+			_stat.clear();
 	}
 
 	constexpr auto capacity() const noexcept {
 		return _Size;
 	}
 
-	auto begin() {
-		return front_it;
+	// logical index, 0 is front
+	T& operator[](size_t idx) {
+		return _Arr::operator[]((_front_idx() + idx) % _Size);
+	}
+
+	const T& operator[](size_t idx) const {
+		return _Arr::operator[]((_front_idx() + idx) % _Size);
+	}
+
+	iterator begin() {
+		return iterator(this, 0);
+	}
+
+	iterator end() {
+		return iterator(this, _size);
 	}
 
-	auto end() {
-		return back_it;
+	const_iterator begin() const {
+		return const_iterator(this, 0);
+	}
+
+	const_iterator end() const {
+		return const_iterator(this, _size);
 	}
 
 	auto& front() {
@@ -141,7 +364,18 @@ public:
 	}
 
 	auto& back() {
-		return *back_it;
+		return (*this)[_size - 1];
+	}
+
+	// contents as (at most) two contiguous segments, front part first
+	ring_spans<T> as_spans() {
+		const size_t n0 = std::min(_size, _Size - _front_idx());
+		return ring_spans<T>({ &*front_it, n0 }, { _Arr::data(), _size - n0 });
+	}
+
+	ring_spans<const T> as_spans() const {
+		const size_t n0 = std::min(_size, _Size - _front_idx());
+		return ring_spans<const T>({ _Arr::data() + _front_idx(), n0 }, { _Arr::data(), _size - n0 });
 	}
 
 	template <class _Ty = T>
@@ -149,6 +383,38 @@ public:
 		return _sum;
 	}
 
+	// window statistics, O(1). window_min / window_max require a non empty buffer
+	template <bool _En = stat_en>
+	std::enable_if_t<_En, double> mean() {
+		return _stat.mean();
+	}
+
+	template <bool _En = stat_en>
+	std::enable_if_t<_En, double> variance() {
+		return _stat.variance();
+	}
+
+	template <class _Ty = T>
+	std::enable_if_t<stat_en, _Ty> window_min() {
+		return _stat.min();
+	}
+
+	template <class _Ty = T>
+	std::enable_if_t<stat_en, _Ty> window_max() {
+		return _stat.max();
+	}
+
+	// recompute sum / mean / variance from the contents to drop accumulated floating point drift
+	template <bool _En = sum_en || stat_en>
+	std::enable_if_t<_En> resync_stat() {
+		const auto seg = as_spans();
+		if constexpr (sum_en)
+			_sum = ringbuffer_stat<T, _Size>::template reduce<T>(seg.first.data(), seg.first.size(), T(0)) +
+				ringbuffer_stat<T, _Size>::template reduce<T>(seg.second.data(), seg.second.size(), T(0));
+		if constexpr (stat_en)
+			_stat.resync(seg.first.data(), seg.first.size(), seg.second.data(), seg.second.size());
+	}
+
 private:
 
 	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
@@ -161,11 +427,8 @@ private:
 
 	template <class _Ty = T, typename std::enable_if< !std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
 	inline void _if_full_delete_once() {
-		if (full()) {
+		if (full())
 			T dummy = incr_front();
-			if constexpr (sum_en)
-				_sum -= dummy;
-		}
 	}
 
 	inline bool _empty() {
@@ -175,37 +438,60 @@ private:
 	void incr_back(const T& _Val) {
 		assert(!full() && "ringbuffer overrun");
 		++_size;
+		_on_push(_Val);
 		*back_it = std::move(_Val);
 		if (++back_it == _Arr::end())
 			back_it = _Arr::begin();
-		if constexpr (sum_en)
-			_sum += _Val;
 	};
 
 	void incr_back(T&& _Val) {
 		assert(!full() && "ringbuffer overrun");
 		++_size;
+		_on_push(_Val);
 		*back_it = std::move(_Val);
 		if (++back_it == _Arr::end())
 			back_it = _Arr::begin();
-		if constexpr (sum_en)
-			_sum += _Val;
 	};
 
 	T&& incr_front() {
 		assert(!_empty() && "ringbuffer underrun");
 		--_size;
+		_on_pull(*front_it);
 		auto before_it = front_it++;
 		if (front_it == _Arr::end())
 			front_it = _Arr::begin();
 		return std::move(*before_it);
 	}
 
+	inline void _on_push(const T& _Val) {
+		if constexpr (sum_en)
+			_sum += _Val;
+		if constexpr (stat_en)
+			_stat.add(_Val);
+	}
+
+	inline void _on_pull(const T& _Val) {
+		if constexpr (sum_en)
+			_sum -= _Val;
+		if constexpr (stat_en)
+			_stat.remove(_Val);
+	}
+
+	void _stat_rebuild() {
+		const auto seg = as_spans();
+		_stat.rebuild(seg.first.data(), seg.first.size(), seg.second.data(), seg.second.size());
+	}
+
+	inline size_t _front_idx() const {
+		return (size_t)(front_it - _Arr::begin());
+	}
+
 	typename _Arr::iterator back_it{ _Arr::begin() };
 	typename _Arr::iterator front_it{ _Arr::begin() };
 
 	size_t _size{ 0 };
 	T _sum;
+	std::conditional_t<stat_en, ringbuffer_stat<T, _Size>, ringbuffer_no_stat> _stat;
 };
 
 #endif // !_RINGBUFFER_H_
@@ -0,0 +1,130 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __SEQLOCK_RINGBUFFER_HPP__
+#define __SEQLOCK_RINGBUFFER_HPP__
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <algorithm>
+
+// latest value overwrite ring for one writer and any number of readers.
+// every slot is guarded by its own sequence counter (odd while being written).
+// the writer never waits: push_back_force always overwrites the oldest slot.
+// readers copy optimistically and retry on a torn read, so they never block the writer.
+template <class T, size_t _Size>
+class seqlock_ringbuffer
+{
+	static_assert(std::is_trivially_copyable<T>::value, "seqlock_ringbuffer requires trivially copyable T");
+	static_assert(_Size > 0, "seqlock_ringbuffer requires _Size > 0");
+public:
+
+	// single writer only. wait free
+	void push_back_force(const T& _Val) noexcept {
+		const size_t idx = _write_idx.load(std::memory_order_relaxed);
+		slot& s = _slots[idx % _Size];
+		const uint64_t seq = s.seq.load(std::memory_order_relaxed);
+		s.seq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		s.store(_Val);
+		s.seq.store(seq + 2, std::memory_order_release);
+		_write_idx.store(idx + 1, std::memory_order_release);
+	}
+
+	// return false : nothing written yet
+	bool read_latest(T& item) const noexcept {
+		return read(0, item);
+	}
+
+	// n_back == 0 is the newest item
+	// return false : fewer than n_back + 1 items written
+	bool read(size_t n_back, T& item) const noexcept {
+		for (;;) {
+			const size_t widx = _write_idx.load(std::memory_order_acquire);
+			if (n_back >= std::min(widx, _Size))
+				return false;
+			if (try_read(widx - 1 - n_back, item))
+				return true;
+		}
+	}
+
+	// copy the newest (at most max_count) items into dst, oldest first
+	// a consistent window is returned: if the writer laps the reader, the copy restarts
+	// return count of copied items
+	size_t snapshot(T* dst, size_t max_count) const noexcept {
+		for (;;) {
+			const size_t widx = _write_idx.load(std::memory_order_acquire);
+			const size_t count = std::min({ widx, _Size, max_count });
+			const size_t first = widx - count;
+			size_t i = 0;
+			for (; i < count; ++i) {
+				if (!try_read(first + i, dst[i]))
+					break;
+			}
+			if (i == count)
+				return count;
+		}
+	}
+
+	size_t size() const noexcept {
+		return std::min(_write_idx.load(std::memory_order_acquire), _Size);
+	}
+
+	bool empty() const noexcept {
+		return _write_idx.load(std::memory_order_acquire) == 0;
+	}
+
+	// total number of items ever written
+	size_t written() const noexcept {
+		return _write_idx.load(std::memory_order_acquire);
+	}
+
+	constexpr auto capacity() const noexcept {
+		return _Size;
+	}
+
+private:
+	static constexpr size_t words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	// payload is kept in relaxed atomic words, so a racing copy is a torn read, not a data race
+	struct alignas(64) slot {
+		void store(const T& _Val) noexcept {
+			uint64_t tmp[words] = { 0, };
+			memcpy(tmp, &_Val, sizeof(T));
+			for (size_t i = 0; i < words; ++i)
+				data[i].store(tmp[i], std::memory_order_relaxed);
+		}
+
+		void load(T& item) const noexcept {
+			uint64_t tmp[words];
+			for (size_t i = 0; i < words; ++i)
+				tmp[i] = data[i].load(std::memory_order_relaxed);
+			memcpy(&item, tmp, sizeof(T));
+		}
+
+		std::atomic<uint64_t> seq{ 0 };
+		std::array<std::atomic<uint64_t>, words> data{};
+	};
+
+	// return false : slot is being written or already holds a newer item than idx
+	bool try_read(size_t idx, T& item) const noexcept {
+		const slot& s = _slots[idx % _Size];
+		// the (idx / _Size)th write of this slot leaves this sequence behind
+		const uint64_t expect = 2 * (uint64_t)(idx / _Size + 1);
+		const uint64_t seq0 = s.seq.load(std::memory_order_acquire);
+		if (seq0 != expect)
+			return false;
+		s.load(item);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return s.seq.load(std::memory_order_relaxed) == seq0;
+	}
+
+	std::array<slot, _Size> _slots;
+	alignas(64) std::atomic<size_t> _write_idx{ 0 };
+};
+
+#endif // !__SEQLOCK_RINGBUFFER_HPP__
@@ -610,7 +610,8 @@ public:
 	template<typename Tp>
 	static inline constexpr std::enable_if_t<serdes::is_c_string_v<std::decay_t<Tp>>,
 		size_t> payload_size(const Tp& c_str) {
-		return std::string(c_str).size();
+		// same layout as serialize() : uint32_t length + characters
+		return sizeof(uint32_t) + std::string(c_str).size();
 	}
 
 	template<typename Tp>
@@ -757,18 +758,19 @@ template<typename buf_t = uint8_t, bool big_endian = false>
 class DynamicSerDes {
 private:
 
-	template<uint16_t class_id, uint16_t func_id,
+	template<uint16_t class_id, uint16_t func_id, typename Alloc,
 		std::size_t... I, typename... Args>
-		inline size_t call_command_serializer(std::vector<uint8_t>& buffer,
+		inline size_t call_command_serializer(std::vector<buf_t, Alloc>& buffer,
 			std::index_sequence<I...>,
 			const std::tuple<Args...>& tup_args) {
 		return build_command<class_id, func_id>(buffer, std::get<I>(tup_args)...);
 	}
 
 public:
-	template<uint16_t class_id, uint16_t func_id, typename Tp0, typename... Args>
+	// buffer may use any allocator, e.g. std::vector<uint8_t, pool_allocator<uint8_t>> (pool_allocator.hpp)
+	template<uint16_t class_id, uint16_t func_id, typename Alloc, typename Tp0, typename... Args>
 	inline typename std::enable_if_t<0 <= sizeof...(Args) && !serdes::is_std_tuple_v<typename std::remove_reference<Tp0>::type>,
-		size_t> build_command(std::vector<buf_t>& buffer, Tp0&& arg0, Args&&... args) {
+		size_t> build_command(std::vector<buf_t, Alloc>& buffer, Tp0&& arg0, Args&&... args) {
 		auto all_arg = std::tuple_cat(std::forward_as_tuple(arg0), std::forward_as_tuple(args)...);
 		const size_t all_arg_size = SerDes<buf_t, big_endian>::payload_size(all_arg);
 		buffer.resize(sizeof(header_type) + all_arg_size);
@@ -776,16 +778,16 @@ public:
 			std::tuple_cat(std::make_tuple(length_header_t((uint32_t)all_arg_size), class_id, func_id), all_arg));
 	}
 
-	template<uint16_t class_id, uint16_t func_id, typename... Args>
+	template<uint16_t class_id, uint16_t func_id, typename Alloc, typename... Args>
 	inline typename std::enable_if_t< 0 == sizeof...(Args),
-		size_t> build_command(std::vector<buf_t>& buffer, Args&&... args) {
+		size_t> build_command(std::vector<buf_t, Alloc>& buffer, Args&&... args) {
 		header_type header(length_header_t(0U), class_id, func_id);
 		buffer.resize(sizeof(header_type));
 		return SerDes<buf_t, big_endian>::serialize(buffer.data(), header);
 	}
 
-	template<uint16_t class_id, uint16_t func_id, typename... Args>
-	inline size_t build_command(std::vector<uint8_t>& buffer,
+	template<uint16_t class_id, uint16_t func_id, typename Alloc, typename... Args>
+	inline size_t build_command(std::vector<buf_t, Alloc>& buffer,
 		const std::tuple<Args...>& tup_args) {
 		return call_command_serializer<class_id, func_id>(buffer,
 			std::index_sequence_for<Args...>{}, tup_args);
@@ -0,0 +1,366 @@
+// revision 1.0 by luj
+// posix only (shm_open + mmap). cross process wake uses futex on linux
+
+#pragma once
+#ifndef __SHM_RINGBUFFER_HPP__
+#define __SHM_RINGBUFFER_HPP__
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include "assert.h"
+#include "wait_policy.hpp"
+
+// single producer / single consumer ring living in a POSIX shared memory segment.
+// the layout holds no pointers (header + slot array at a fixed offset), so every process can map it anywhere.
+// same push / pull interface as safe_ringbuffer; *_notify and *_wait use a futex in the segment to wake across processes.
+template <class T>
+class shm_ringbuffer
+{
+	static_assert(std::is_trivially_copyable<T>::value, "shm_ringbuffer requires trivially copyable T");
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "shm_ringbuffer requires address free 64bit atomics");
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "shm_ringbuffer requires address free 32bit atomics");
+	static constexpr unsigned spin_count = 1024;
+public:
+
+	// create the segment. capacity is rounded up to a power of two.
+	// throws std::system_error (EEXIST) when the name is taken, unlink() a stale segment first
+	shm_ringbuffer(const char* name, size_t capacity) {
+		size_t cap = 1;
+		while (cap < capacity)
+			cap <<= 1;
+
+		int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0660);
+		if (fd < 0)
+			throw std::system_error(errno, std::generic_category(), "shm_open");
+		// the name is ours now. remove it on failure, or every later create gets EEXIST
+		_bytes = data_offset + cap * sizeof(T);
+		if (ftruncate(fd, (off_t)_bytes) != 0) {
+			int err = errno;
+			close(fd);
+			shm_unlink(name);
+			throw std::system_error(err, std::generic_category(), "ftruncate");
+		}
+		try {
+			map(fd);
+		}
+		catch (...) {
+			shm_unlink(name);
+			throw;
+		}
+
+		new (_hdr) header();
+		_hdr->version = layout_version;
+		_hdr->elem_size = (uint32_t)sizeof(T);
+		_hdr->capacity = cap;
+		_hdr->magic.store(layout_magic, std::memory_order_release);
+		_mask = cap - 1;
+	}
+
+	// open a segment created by another process.
+	// waits up to about a second for a creator that is still sizing / initializing the segment
+	explicit shm_ringbuffer(const char* name) {
+		int fd = shm_open(name, O_RDWR, 0660);
+		if (fd < 0)
+			throw std::system_error(errno, std::generic_category(), "shm_open");
+
+		// the creator ftruncates right after shm_open, the size goes from 0 to final in one step
+		for (int retry = 0; ; ++retry) {
+			struct stat st;
+			if (fstat(fd, &st) != 0) {
+				int err = errno;
+				close(fd);
+				throw std::system_error(err, std::generic_category(), "fstat");
+			}
+			_bytes = (size_t)st.st_size;
+			if (_bytes >= data_offset)
+				break;
+			if (retry > open_retries) {
+				close(fd);
+				throw std::runtime_error("shm_ringbuffer : segment too small");
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		map(fd);
+
+		// the creator publishes magic last
+		for (int retry = 0; _hdr->magic.load(std::memory_order_acquire) != layout_magic; ++retry) {
+			if (retry > open_retries) {
+				munmap(_hdr, _bytes);
+				throw std::runtime_error("shm_ringbuffer : segment not initialized");
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		if (_hdr->version != layout_version || _hdr->elem_size != sizeof(T) ||
+			data_offset + _hdr->capacity * sizeof(T) > _bytes) {
+			munmap(_hdr, _bytes);
+			throw std::runtime_error("shm_ringbuffer : layout mismatch");
+		}
+		_mask = (size_t)_hdr->capacity - 1;
+	}
+
+	~shm_ringbuffer() {
+		munmap(_hdr, _bytes);
+	}
+
+	shm_ringbuffer(const shm_ringbuffer&) = delete;
+	shm_ringbuffer& operator= (const shm_ringbuffer&) = delete;
+
+	// remove the name. mapped segments stay valid until every process unmaps
+	static bool unlink(const char* name) {
+		return shm_unlink(name) == 0;
+	}
+
+	// ---------------------------
+	// producer (one thread in one process)
+	// ---------------------------
+
+	// return false : buffer is full
+	bool push_back(const T& _Val) {
+		T* slot = reserve();
+		if (slot == nullptr)
+			return false;
+		memcpy(slot, &_Val, sizeof(T));
+		commit(1);
+		return true;
+	}
+
+	// return false : buffer is full
+	bool push_back_notify(const T& _Val) {
+		if (!push_back(_Val))
+			return false;
+		notify();
+		return true;
+	}
+
+	// return nullptr : buffer is full
+	T* reserve() {
+		const uint64_t tail = _hdr->tail.load(std::memory_order_relaxed);
+		if (tail - _hdr->head.load(std::memory_order_acquire) == capacity())
+			return nullptr;
+		return slots() + (tail & _mask);
+	}
+
+	// return count of contiguous writable slots from ptr (at most n)
+	size_t reserve(T*& ptr, size_t n) {
+		const uint64_t tail = _hdr->tail.load(std::memory_order_relaxed);
+		ptr = slots() + (tail & _mask);
+		const size_t free_slots = capacity() - (size_t)(tail - _hdr->head.load(std::memory_order_acquire));
+		return std::min({ n, free_slots, capacity() - (size_t)(tail & _mask) });
+	}
+
+	// publish n slots written through reserve()
+	void commit(size_t n = 1) {
+		const uint64_t tail = _hdr->tail.load(std::memory_order_relaxed);
+		assert(n <= capacity() - (tail - _hdr->head.load(std::memory_order_relaxed)) && "ringbuffer overrun");
+		_hdr->tail.store(tail + n, std::memory_order_release);
+	}
+
+	void commit_notify(size_t n = 1) {
+		commit(n);
+		notify();
+	}
+
+	// ---------------------------
+	// consumer (one thread in one process)
+	// ---------------------------
+
+	// return false : buffer is empty
+	bool pull_front(T& item) {
+		T* slot = peek();
+		if (slot == nullptr)
+			return false;
+		memcpy(&item, slot, sizeof(T));
+		release(1);
+		return true;
+	}
+
+	// blocking function
+	// return false : woken by wait_break
+	bool pull_front_wait(T& item) {
+		if (pull_front(item))
+			return true;
+		const uint32_t gen = _hdr->breaks.load(std::memory_order_acquire);
+		for (;;) {
+			const uint32_t key = prepare_wait();
+			if (!_empty() || _hdr->breaks.load(std::memory_order_acquire) != gen) {
+				_hdr->waiters.fetch_sub(1, std::memory_order_relaxed);
+				return pull_front(item);
+			}
+			park(key, nullptr);
+		}
+	}
+
+	// return false : wait timeout or woken by wait_break
+	template<class _Rep, class _Period>
+	bool pull_front_wait(T& item, const std::chrono::duration<_Rep, _Period>& _Rel_time) {
+		if (pull_front(item))
+			return true;
+		const auto deadline = std::chrono::steady_clock::now() + _Rel_time;
+		const uint32_t gen = _hdr->breaks.load(std::memory_order_acquire);
+		for (;;) {
+			const uint32_t key = prepare_wait();
+			const auto now = std::chrono::steady_clock::now();
+			if (!_empty() || _hdr->breaks.load(std::memory_order_acquire) != gen || now >= deadline) {
+				_hdr->waiters.fetch_sub(1, std::memory_order_relaxed);
+				return pull_front(item);
+			}
+			const auto rel = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now);
+			park(key, &rel);
+		}
+	}
+
+	// return nullptr : buffer is empty
+	T* peek() {
+		const uint64_t head = _hdr->head.load(std::memory_order_relaxed);
+		if (_hdr->tail.load(std::memory_order_acquire) == head)
+			return nullptr;
+		return slots() + (head & _mask);
+	}
+
+	// return count of contiguous readable slots from ptr (at most n)
+	size_t peek(T*& ptr, size_t n) {
+		const uint64_t head = _hdr->head.load(std::memory_order_relaxed);
+		ptr = slots() + (head & _mask);
+		const size_t used = (size_t)(_hdr->tail.load(std::memory_order_acquire) - head);
+		return std::min({ n, used, capacity() - (size_t)(head & _mask) });
+	}
+
+	// free n slots read through peek()
+	void release(size_t n = 1) {
+		const uint64_t head = _hdr->head.load(std::memory_order_relaxed);
+		assert(n <= _hdr->tail.load(std::memory_order_relaxed) - head && "ringbuffer underrun");
+		_hdr->head.store(head + n, std::memory_order_release);
+	}
+
+	// the consumer blocked in pull_front_wait returns false
+	void wait_break() {
+		_hdr->breaks.fetch_add(1, std::memory_order_seq_cst);
+		_hdr->seq.fetch_add(1, std::memory_order_seq_cst);
+		wake();
+	}
+
+	bool empty() {
+		return _empty();
+	}
+
+	bool full() {
+		return size() == capacity();
+	}
+
+	size_t size() {
+		return (size_t)(_hdr->tail.load(std::memory_order_acquire) - _hdr->head.load(std::memory_order_acquire));
+	}
+
+	size_t capacity() const noexcept {
+		return (size_t)_hdr->capacity;
+	}
+
+private:
+	static constexpr uint64_t layout_magic = 0x73686d5f72696e67ULL; // "shm_ring"
+	static constexpr uint32_t layout_version = 1;
+	static constexpr int open_retries = 1000;	// 1ms each
+
+	struct header {
+		std::atomic<uint64_t> magic{ 0 };
+		uint32_t version{ 0 };
+		uint32_t elem_size{ 0 };
+		uint64_t capacity{ 0 };
+		alignas(64) std::atomic<uint64_t> tail{ 0 };	// producer
+		alignas(64) std::atomic<uint64_t> head{ 0 };	// consumer
+		alignas(64) std::atomic<uint32_t> seq{ 0 };	// futex word
+		std::atomic<uint32_t> waiters{ 0 };
+		std::atomic<uint32_t> breaks{ 0 };	// wait_break generation
+	};
+
+	static constexpr size_t data_align = alignof(T) > 64 ? alignof(T) : 64;
+	static constexpr size_t data_offset = (sizeof(header) + data_align - 1) / data_align * data_align;
+
+	void map(int fd) {
+		void* ptr = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		int err = errno;
+		close(fd);
+		if (ptr == MAP_FAILED)
+			throw std::system_error(err, std::generic_category(), "mmap");
+		_hdr = static_cast<header*>(ptr);
+	}
+
+	inline T* slots() const noexcept {
+		return reinterpret_cast<T*>(reinterpret_cast<uint8_t*>(_hdr) + data_offset);
+	}
+
+	inline bool _empty() {
+		return _hdr->tail.load(std::memory_order_acquire) == _hdr->head.load(std::memory_order_relaxed);
+	}
+
+	uint32_t prepare_wait() {
+		_hdr->waiters.fetch_add(1, std::memory_order_seq_cst);
+		return _hdr->seq.load(std::memory_order_seq_cst);
+	}
+
+	// spin a little, then sleep on the shared futex word until the producer bumps it
+	void park(uint32_t key, const std::chrono::nanoseconds* rel_time) {
+		for (unsigned i = 0; i < spin_count && _empty() && _hdr->seq.load(std::memory_order_relaxed) == key; ++i)
+			cpu_relax();
+		if (_empty() && _hdr->seq.load(std::memory_order_seq_cst) == key) {
+#ifdef __linux__
+			struct timespec ts;
+			if (rel_time) {
+				ts.tv_sec = (time_t)(rel_time->count() / 1000000000);
+				ts.tv_nsec = (long)(rel_time->count() % 1000000000);
+			}
+			syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_hdr->seq), FUTEX_WAIT, key, rel_time ? &ts : nullptr, nullptr, 0);
+#else
+			const auto deadline = std::chrono::steady_clock::now() +
+				(rel_time ? *rel_time : std::chrono::nanoseconds::max() / 2);
+			while (_empty() && _hdr->seq.load(std::memory_order_seq_cst) == key &&
+				std::chrono::steady_clock::now() < deadline)
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+#endif
+		}
+		_hdr->waiters.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	// producer side. skips everything but a fence and a load when the consumer is not waiting
+	void notify() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (_hdr->waiters.load(std::memory_order_seq_cst) == 0)
+			return;
+		_hdr->seq.fetch_add(1, std::memory_order_seq_cst);
+		wake();
+	}
+
+	void wake() {
+#ifdef __linux__
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_hdr->seq), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+	}
+
+	header* _hdr{ nullptr };
+	size_t _bytes{ 0 };
+	size_t _mask{ 0 };
+};
+
+#endif // !_WIN32
+
+#endif // !__SHM_RINGBUFFER_HPP__
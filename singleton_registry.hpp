@@ -0,0 +1,199 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __SINGLETON_REGISTRY_HPP__
+#define __SINGLETON_REGISTRY_HPP__
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#include "thread_pool.hpp"
+
+// eager, dependency ordered construction of Singleton<T> subsystems.
+//	singleton_registry::get().add<Database, Config, Logger>();	// Database needs Config and Logger
+//	singleton_registry::get().startup(&pool);					// independent ones build in parallel
+//	...
+//	singleton_registry::get().teardown();						// dependents first
+// T needs static get() / destroy() (Singleton<T> provides both), so lazy T::get() users see the same instance
+class singleton_registry
+{
+public:
+	static singleton_registry& get() {
+		static singleton_registry registry;
+		return registry;
+	}
+
+	singleton_registry(const singleton_registry&) = delete;
+	singleton_registry& operator= (const singleton_registry&) = delete;
+
+	// register T with its dependencies. registering T again replaces its dependency list
+	template <class T, class... Deps>
+	void add() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _index.find(std::type_index(typeid(T)));
+		if (it == _index.end()) {
+			it = _index.emplace(std::type_index(typeid(T)), _entries.size()).first;
+			_entries.emplace_back();
+		}
+		entry& e = _entries[it->second];
+		e.name = typeid(T).name();
+		e.deps = { std::type_index(typeid(Deps))... };
+		e.create = []() { T::get(); };
+		e.destroy = []() { T::destroy(); };
+	}
+
+	// blocking function
+	// construct every registered singleton, each after its dependencies.
+	// pool == nullptr : one by one on the calling thread. do not call from a task running on pool, nor add() meanwhile.
+	// throws std::logic_error on an unknown dependency or a cycle, or rethrows the first constructor exception
+	// (after the constructions already running finish; nothing new starts after a failure)
+	void startup(thread_pool* pool = nullptr) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		const size_t n = _entries.size();
+
+		std::vector<std::vector<size_t>> dependents(n);
+		std::vector<size_t> pending(n, 0);
+		for (size_t i = 0; i < n; ++i) {
+			for (auto& d : _entries[i].deps) {
+				auto it = _index.find(d);
+				if (it == _index.end())
+					throw std::logic_error("singleton_registry : " + _entries[i].name + " depends on unregistered " + d.name());
+				dependents[it->second].push_back(i);
+				++pending[i];
+			}
+		}
+		check_cycles(dependents, pending);
+
+		_order.clear();
+		size_t running = 0;
+		size_t finished = 0;
+		std::exception_ptr error;
+
+		// called with lock held
+		std::function<void(size_t)> launch = [&](size_t i) {
+			++running;
+			auto job = [&, i]() {
+				std::exception_ptr err;
+				try {
+					_entries[i].create();
+				}
+				catch (...) {
+					err = std::current_exception();
+				}
+				std::lock_guard<std::mutex> done_lock(_mutex);
+				--running;
+				++finished;
+				if (err) {
+					if (!error)
+						error = err;
+					err = nullptr;	// drop our reference while startup() still waits for us
+				}
+				else {
+					_order.push_back(i);
+					if (!error) {
+						for (size_t d : dependents[i]) {
+							if (--pending[d] == 0)
+								launch(d);
+						}
+					}
+				}
+				_done.notify_all();
+			};
+			if (pool) {
+				pool->post(job);
+			}
+			else {
+				// run inline without the lock, dependents launched by job run the same way
+				_inline_jobs.push_back(job);
+			}
+		};
+
+		for (size_t i = 0; i < n; ++i) {
+			if (pending[i] == 0)
+				launch(i);
+		}
+
+		if (pool) {
+			_done.wait(lock, [&] { return running == 0; });
+		}
+		else {
+			while (!_inline_jobs.empty()) {
+				std::function<void()> job = std::move(_inline_jobs.front());
+				_inline_jobs.erase(_inline_jobs.begin());
+				lock.unlock();
+				job();
+				lock.lock();
+			}
+		}
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	// destroy the singletons built by startup(), dependents before their dependencies
+	void teardown() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (auto it = _order.rbegin(); it != _order.rend(); ++it)
+			_entries[*it].destroy();
+		_order.clear();
+	}
+
+	size_t size() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _entries.size();
+	}
+
+private:
+	singleton_registry() = default;
+
+	struct entry {
+		std::string name;
+		std::vector<std::type_index> deps;
+		std::function<void()> create;
+		std::function<void()> destroy;
+	};
+
+	// Kahn's algorithm on a copy. throws when some entries never become ready
+	void check_cycles(const std::vector<std::vector<size_t>>& dependents, std::vector<size_t> pending) {
+		std::vector<size_t> ready;
+		for (size_t i = 0; i < pending.size(); ++i) {
+			if (pending[i] == 0)
+				ready.push_back(i);
+		}
+		size_t visited = 0;
+		while (!ready.empty()) {
+			const size_t i = ready.back();
+			ready.pop_back();
+			++visited;
+			for (size_t d : dependents[i]) {
+				if (--pending[d] == 0)
+					ready.push_back(d);
+			}
+		}
+		if (visited == pending.size())
+			return;
+		std::string names;
+		for (size_t i = 0; i < pending.size(); ++i) {
+			if (pending[i] != 0)
+				names += (names.empty() ? "" : ", ") + _entries[i].name;
+		}
+		throw std::logic_error("singleton_registry : dependency cycle among " + names);
+	}
+
+	std::mutex _mutex;
+	std::condition_variable _done;
+	std::vector<entry> _entries;
+	std::unordered_map<std::type_index, size_t> _index;
+	std::vector<size_t> _order;		// construction order of the last startup()
+	std::vector<std::function<void()>> _inline_jobs;
+};
+
+#endif // !__SINGLETON_REGISTRY_HPP__
@@ -0,0 +1,318 @@
+// revision 1.0 by luj
+// for cross platform (cpu pinning on linux only)
+
+#pragma once
+#ifndef __THREAD_POOL_HPP__
+#define __THREAD_POOL_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "lockfree_queue.hpp"
+#include "work_stealing_deque.hpp"
+#include "wait_policy.hpp"
+
+// work stealing executor shared by all components instead of one thread per queue.
+//	- tasks submitted from a worker go to its own work_stealing_deque (lifo, cache warm)
+//	- tasks submitted from outside go to a global lockfree_queue (fifo)
+//	- idle workers steal from the front of other workers' deques, then park on an eventcount
+//	- submit wakes a worker only when one is parked
+class thread_pool
+{
+private:
+	static constexpr unsigned spin_count = 4096;
+	static constexpr unsigned yield_count = 16;
+
+	struct task_base {
+		virtual ~task_base() {}
+		virtual void run() = 0;
+	};
+
+	template <class F>
+	struct task_impl : task_base {
+		explicit task_impl(F&& f_) : f(std::move(f_)) {}
+		void run() override { f(); }
+		F f;
+	};
+
+	struct worker {
+		explicit worker(size_t index_) : index(index_), rng((uint32_t)index_ * 2654435761u + 1) {}
+		work_stealing_deque<task_base*> local;
+		std::thread thread;
+		const size_t index;
+		uint32_t rng;
+	};
+
+	struct worker_context {
+		thread_pool* pool{ nullptr };
+		worker* self{ nullptr };
+	};
+
+public:
+	// threads == 0 : one per hardware thread
+	// pin_threads  : pin worker i to cpu i % hardware threads
+	explicit thread_pool(size_t threads = 0, bool pin_threads = false) {
+		const size_t hw = hardware_threads();
+		std::vector<int> cpus;
+		if (pin_threads) {
+			for (size_t i = 0; i < hw; ++i)
+				cpus.push_back((int)i);
+		}
+		start(threads ? threads : hw, cpus);
+	}
+
+	// worker i is pinned to cpus[i % cpus.size()]
+	thread_pool(size_t threads, const std::vector<int>& cpus) {
+		start(threads ? threads : hardware_threads(), cpus);
+	}
+
+	~thread_pool() {
+		shutdown(true);
+	}
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator= (const thread_pool&) = delete;
+
+	// run f(args...) on the pool. exceptions are delivered through the future
+	template <class F, class... Args>
+	auto submit(F&& f, Args&&... args) -> std::future<decltype(std::declval<F>()(std::declval<Args>()...))> {
+		typedef decltype(std::declval<F>()(std::declval<Args>()...)) result_type;
+		std::packaged_task<result_type()> task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+		std::future<result_type> ret = task.get_future();
+		post(std::move(task));
+		return ret;
+	}
+
+	// fire and forget. an exception escaping f is swallowed
+	template <class F>
+	void post(F&& f) {
+		typedef typename std::decay<F>::type fn_t;
+		schedule(new task_impl<guarded<fn_t>>(guarded<fn_t>{ fn_t(std::forward<F>(f)) }));
+	}
+
+	// blocking function
+	// f(i) for i in [first, last), split into chunks of grain (0 : picked from the pool size).
+	// the calling thread works on chunks too, so it is safe to call from inside a task.
+	// the first exception thrown by f is rethrown here after all started chunks finish
+	template <class Index, class F>
+	void parallel_for(Index first, Index last, F&& f, size_t grain = 0) {
+		if (!(first < last))
+			return;
+		const size_t n = (size_t)(last - first);
+		if (grain == 0)
+			grain = std::max<size_t>(1, n / (_workers.size() * 4));
+		const size_t chunks = (n + grain - 1) / grain;
+
+		struct state {
+			std::atomic<size_t> next{ 0 };
+			std::atomic<size_t> done{ 0 };
+			std::atomic<bool> failed{ false };
+			std::exception_ptr error;
+		};
+		auto st = std::make_shared<state>();
+		auto body = [st, first, n, grain, chunks, &f]() {
+			for (;;) {
+				const size_t c = st->next.fetch_add(1, std::memory_order_relaxed);
+				if (c >= chunks)
+					return;
+				if (!st->failed.load(std::memory_order_relaxed)) {
+					try {
+						const size_t lo = c * grain;
+						const size_t hi = std::min(n, lo + grain);
+						for (size_t i = lo; i < hi; ++i)
+							f(first + (Index)i);
+					}
+					catch (...) {
+						bool expected = false;
+						if (st->failed.compare_exchange_strong(expected, true))
+							st->error = std::current_exception();
+					}
+				}
+				st->done.fetch_add(1, std::memory_order_acq_rel);
+			}
+		};
+
+		// helpers that start after the range is exhausted return at once, they only hold st alive
+		const size_t helpers = std::min(_workers.size(), chunks - 1);
+		for (size_t i = 0; i < helpers; ++i)
+			post(body);
+		body();
+
+		// only chunks already taken by running helpers are left
+		for (unsigned spin = 0; st->done.load(std::memory_order_acquire) < chunks; ++spin) {
+			if (spin < spin_count)
+				cpu_relax();
+			else
+				std::this_thread::yield();
+		}
+		if (st->error)
+			std::rethrow_exception(st->error);
+	}
+
+	// blocking function
+	// drain = true  : run every queued task (including tasks they submit) before stopping
+	// drain = false : stop after the running tasks, queued tasks are dropped (their futures get broken_promise)
+	// submit after shutdown from outside the pool throws std::runtime_error
+	void shutdown(bool drain = true) {
+		if (_stopping.exchange(true))
+			return;
+		_discard.store(!drain, std::memory_order_release);
+		_ec.notify_all();
+		for (auto& w : _workers) {
+			if (w->thread.joinable())
+				w->thread.join();
+		}
+		task_base* t;
+		for (auto& w : _workers) {
+			while (w->local.pull_back(t))
+				delete t;
+		}
+		while (_injection.pull_front(t))
+			delete t;
+	}
+
+	size_t size() const noexcept {
+		return _workers.size();
+	}
+
+	// index of the calling worker in this pool, -1 from other threads
+	int current_index() const noexcept {
+		const worker_context& ctx = context();
+		return ctx.pool == this ? (int)ctx.self->index : -1;
+	}
+
+	static size_t hardware_threads() noexcept {
+		const unsigned n = std::thread::hardware_concurrency();
+		return n ? n : 1;
+	}
+
+private:
+	template <class F>
+	struct guarded {
+		void operator()() {
+			try {
+				f();
+			}
+			catch (...) {
+			}
+		}
+		F f;
+	};
+
+	static worker_context& context() noexcept {
+		static thread_local worker_context ctx;
+		return ctx;
+	}
+
+	void start(size_t threads, const std::vector<int>& cpus) {
+		for (size_t i = 0; i < threads; ++i)
+			_workers.emplace_back(new worker(i));
+		for (size_t i = 0; i < threads; ++i) {
+			worker* w = _workers[i].get();
+			w->thread = std::thread([this, w]() { run(w); });
+			if (!cpus.empty())
+				pin(w->thread, cpus[i % cpus.size()]);
+		}
+	}
+
+	static void pin(std::thread& t, int cpu) {
+#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#else
+		(void)t;
+		(void)cpu;
+#endif
+	}
+
+	void schedule(task_base* t) {
+		const worker_context& ctx = context();
+		if (ctx.pool == this) {
+			ctx.self->local.push_back(t);
+		}
+		else {
+			if (_stopping.load(std::memory_order_acquire)) {
+				delete t;
+				throw std::runtime_error("thread_pool : submit after shutdown");
+			}
+			_injection.push_back(t);
+		}
+		_ec.notify_one();
+	}
+
+	bool find_task(worker* self, task_base*& t) {
+		if (self->local.pull_back(t))
+			return true;
+		if (_injection.pull_front(t))
+			return true;
+		const size_t n = _workers.size();
+		if (n > 1) {
+			// xorshift, start stealing at a random victim
+			self->rng ^= self->rng << 13;
+			self->rng ^= self->rng >> 17;
+			self->rng ^= self->rng << 5;
+			const size_t start = self->rng % n;
+			for (size_t i = 0; i < n; ++i) {
+				worker* victim = _workers[(start + i) % n].get();
+				if (victim != self && victim->local.steal(t))
+					return true;
+			}
+		}
+		return false;
+	}
+
+	void run(worker* self) {
+		worker_context& ctx = context();
+		ctx.pool = this;
+		ctx.self = self;
+
+		task_base* t;
+		for (;;) {
+			if (_discard.load(std::memory_order_acquire))
+				break;
+			if (find_task(self, t)) {
+				t->run();
+				delete t;
+				continue;
+			}
+			const uint32_t key = _ec.prepare_wait();
+			if (find_task(self, t)) {
+				_ec.cancel_wait();
+				t->run();
+				delete t;
+				continue;
+			}
+			if (_stopping.load(std::memory_order_acquire)) {
+				_ec.cancel_wait();
+				break;
+			}
+			_ec.template wait<spin_count, yield_count>(key);
+		}
+
+		ctx.pool = nullptr;
+		ctx.self = nullptr;
+	}
+
+	std::vector<std::unique_ptr<worker>> _workers;
+	lockfree_queue<task_base*> _injection;
+	eventcount _ec;
+	std::atomic<bool> _stopping{ false };
+	std::atomic<bool> _discard{ false };
+};
+
+#endif // !__THREAD_POOL_HPP__
@@ -6,12 +6,19 @@
 #define __SAFE_DEQUE_HPP__
 
 #include <deque>
+#include <algorithm>
 #include <mutex>
 #include <condition_variable>
 #include <type_traits>
 #include <memory>
-
-template <typename T, typename Alloc = std::allocator<T>>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include "wait_policy.hpp"
+#include "container_stats.hpp"
+
+// the public condition_variable base is only signalled with cv_wait_policy, use wait_break() to release waiters
+template <typename T, typename Alloc = std::allocator<T>, typename WaitPolicy = cv_wait_policy, typename StatsPolicy = no_stats>
 class safe_deque : public std::deque<T, Alloc>, public std::mutex, public std::condition_variable
 {
 public:
@@ -47,6 +54,7 @@ private:
 public:
 #endif
 
+	// allocates a shared_ptr control block per call. hot paths should use object_pool<T> (object_pool.hpp)
 	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
 	auto pull_front_auto_recycle() {
 		using T_nptr = typename std::remove_pointer<T>::type;
@@ -54,78 +62,198 @@ public:
 		if (!pull_front(tmp)) 
 			tmp = new T_nptr;
 
-		return std::shared_ptr<T_nptr>(tmp, [&](T del){ push_back(del); });
+		return std::shared_ptr<T_nptr>(tmp, [&](T del){ if (!push_back(del)) delete del; });
 	}
 
 	inline bool empty() {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		return this->std::deque<T, Alloc>::empty();
 	}
 
 	inline size_t size() {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		return this->std::deque<T, Alloc>::size();
 	}
 
-	inline void push_back_notify(const T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+	// with a capacity set (set_capacity) every push below fails on a full queue,
+	// push_back_wait* block for space instead
+
+	// return false : queue is full
+	inline bool push_back_notify(const T& _Val) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		if (_reject_full())
+			return false;
 		this->std::deque<T, Alloc>::push_back(_Val);
-		std::condition_variable::notify_one();
+		_on_push();
+		_wait_policy.notify(*this);
+		return true;
 	}
 
-	inline void push_back(const T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+	// return false : queue is full
+	inline bool push_back(const T& _Val) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		if (_reject_full())
+			return false;
 		this->std::deque<T, Alloc>::push_back(_Val);
+		_on_push();
+		return true;
 	}
 
-	inline void push_back_notify(T&& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+	inline bool push_back_notify(T&& _Val) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		if (_reject_full())
+			return false;
 		this->std::deque<T, Alloc>::push_back(_Val);
-		std::condition_variable::notify_one();
+		_on_push();
+		_wait_policy.notify(*this);
+		return true;
 	}
 
-	inline void push_back(T&& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+	inline bool push_back(T&& _Val) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		if (_reject_full())
+			return false;
 		this->std::deque<T, Alloc>::push_back(_Val);
+		_on_push();
+		return true;
 	}
 
-	inline void push_front(const T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+	// return false : queue is full
+	inline bool push_front(const T& _Val) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		if (_reject_full())
+			return false;
 		this->std::deque<T, Alloc>::push_front(_Val);
+		_on_push();
+		return true;
 	}
 
-	inline void push_front(T&& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+	inline bool push_front(T&& _Val) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		if (_reject_full())
+			return false;
 		this->std::deque<T, Alloc>::push_front(_Val);
+		_on_push();
+		return true;
 	}
 
-	inline void push_front_notify(const T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+	// return false : queue is full
+	inline bool push_front_notify(const T& _Val) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		if (_reject_full())
+			return false;
 		this->std::deque<T, Alloc>::push_front(_Val);
-		std::condition_variable::notify_one();
+		_on_push();
+		_wait_policy.notify(*this);
+		return true;
 	}
 
-	inline void push_front_notify(T&& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+	inline bool push_front_notify(T&& _Val) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		if (_reject_full())
+			return false;
 		this->std::deque<T, Alloc>::push_front(_Val);
-		std::condition_variable::notify_one();
+		_on_push();
+		_wait_policy.notify(*this);
+		return true;
+	}
+
+	// enqueue [first, last) with one lock
+	// return count of pushed items. stops early when the queue is full
+	template <class _Iter>
+	inline size_t push_range(_Iter first, _Iter last) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		return _push_range(first, last);
+	}
+
+	// enqueue [first, last) with one lock and one notify. consumers should drain with pull_all / pull_up_to
+	// return count of pushed items. stops early when the queue is full
+	template <class _Iter>
+	inline size_t push_range_notify(_Iter first, _Iter last) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		const size_t count = _push_range(first, last);
+		if (count)
+			_wait_policy.notify(*this);
+		return count;
 	}
 
 	// non blocking function
 	// return true : pull front success
 	// return false : fail to pull
 	inline bool pull_front(T& item) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		if (!this->std::deque<T, Alloc>::empty()) {
 			item = std::move(this->std::deque<T, Alloc>::front());
 			this->std::deque<T, Alloc>::pop_front();
+			_on_pull(1);
 			return true;
 		}
 		return false;
 	}
 
+	// non blocking function
+	// move every item to the back of out with one lock. O(1) swap when out is empty
+	// return count of pulled items
+	inline size_t pull_all(std::deque<T, Alloc>& out) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		return _pull_all(out);
+	}
+
+	// non blocking function
+	// move at most max_count items from the front to the back of out (any container with push_back) with one lock
+	// return count of pulled items
+	template <class _Container>
+	inline size_t pull_up_to(_Container& out, size_t max_count) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		return _pull_up_to(out, max_count);
+	}
+
+	// blocking funtion
+	// return count of pulled items. 0 : woken by wait_break
+	inline size_t pull_all_wait(std::deque<T, Alloc>& out) {
+		std::unique_lock<std::mutex> lock = _stats.unique_lock(*this);
+		const uint64_t gen = _pull_break;
+		while (this->std::deque<T, Alloc>::empty() && gen == _pull_break) {
+			_wait_policy.wait(lock, *this);
+			if (this->std::deque<T, Alloc>::empty())
+				_stats.on_empty_wakeup();
+		}
+		return _pull_all(out);
+	}
+
+	// return count of pulled items. 0 : wait timeout or woken by wait_break
+	template<class _Rep, class _Period>
+	size_t pull_all_wait(std::deque<T, Alloc>& out, const std::chrono::duration<_Rep, _Period>& _Rel_time) {
+		std::unique_lock<std::mutex> lock = _stats.unique_lock(*this);
+		const auto deadline = std::chrono::steady_clock::now() + _Rel_time;
+		const uint64_t gen = _pull_break;
+		while (this->std::deque<T, Alloc>::empty() && gen == _pull_break) {
+			const auto now = std::chrono::steady_clock::now();
+			if (now >= deadline)
+				break;
+			_wait_policy.wait_for(lock, *this, deadline - now);
+			if (this->std::deque<T, Alloc>::empty())
+				_stats.on_empty_wakeup();
+		}
+		return _pull_all(out);
+	}
+
+	// blocking funtion
+	// return count of pulled items. 0 : woken by wait_break
+	template <class _Container>
+	inline size_t pull_up_to_wait(_Container& out, size_t max_count) {
+		std::unique_lock<std::mutex> lock = _stats.unique_lock(*this);
+		const uint64_t gen = _pull_break;
+		while (this->std::deque<T, Alloc>::empty() && gen == _pull_break) {
+			_wait_policy.wait(lock, *this);
+			if (this->std::deque<T, Alloc>::empty())
+				_stats.on_empty_wakeup();
+		}
+		return _pull_up_to(out, max_count);
+	}
+
 	inline bool try_get_front(T& item) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		if (!this->std::deque<T, Alloc>::empty()) {
 			item = this->std::deque<T, Alloc>::front();
 			return true;
@@ -134,7 +262,7 @@ public:
 	}
 
 	inline bool try_get_back(T& item) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		if (!this->std::deque<T, Alloc>::empty()) {
 			item = this->std::deque<T, Alloc>::back();
 			return true;
@@ -143,59 +271,347 @@ public:
 	}
 
 	inline T& back() {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		return this->std::deque<T, Alloc>::back();
 	}
 
 	inline T& front() {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		return this->std::deque<T, Alloc>::front();
 	}
 
 	inline void pop_front() {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		this->std::deque<T, Alloc>::pop_front();
+		_on_pull(1);
 	}
 
 	inline void pop_back() {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		this->std::deque<T, Alloc>::pop_back();
+		_on_pull(1);
 	}
 
 	// blocking funtion
 	// return true : pull front success
-	// return false : fail to pull, and other than push_back destroys wait
+	// return false : fail to pull, woken by wait_break
 	inline bool pull_front_wait(T& item) {
-		std::unique_lock<std::mutex> lock(*this);
+		std::unique_lock<std::mutex> lock = _stats.unique_lock(*this);
 
-		bool empty = this->std::deque<T, Alloc>::empty();
-		while (empty) {
-			std::condition_variable::wait(lock);
-			if (empty = this->std::deque<T, Alloc>::empty())
+		const uint64_t gen = _pull_break;
+		while (this->std::deque<T, Alloc>::empty()) {
+			if (gen != _pull_break)
 				return false;
+			_wait_policy.wait(lock, *this);
+			if (this->std::deque<T, Alloc>::empty())
+				_stats.on_empty_wakeup();
 		}
 		item = std::move(this->std::deque<T, Alloc>::front());
 		this->std::deque<T, Alloc>::pop_front();
+		_on_pull(1);
 		return true;
 	}
 
 	template<class _Rep, class _Period>
 	bool pull_front_wait(T& item, const std::chrono::duration<_Rep, _Period>& _Rel_time) {
-		std::unique_lock<std::mutex> lock(*this);
-		if (std::deque<T, Alloc>::empty()) {
-			wait_for(lock, _Rel_time);
-			if (std::deque<T, Alloc>::empty())
+		std::unique_lock<std::mutex> lock = _stats.unique_lock(*this);
+		const auto deadline = std::chrono::steady_clock::now() + _Rel_time;
+		const uint64_t gen = _pull_break;
+		while (std::deque<T, Alloc>::empty()) {
+			const auto now = std::chrono::steady_clock::now();
+			if (gen != _pull_break || now >= deadline)
 				return false;
+			_wait_policy.wait_for(lock, *this, deadline - now);
+			if (std::deque<T, Alloc>::empty())
+				_stats.on_empty_wakeup();
 		}
 		item = std::move(this->std::deque<T, Alloc>::front());
 		this->std::deque<T, Alloc>::pop_front();
+		_on_pull(1);
 		return true;
 	}
 
+	// all zero with no_stats
+	container_stats stats() const {
+		return _stats.snapshot();
+	}
+
+	void reset_stats() {
+		_stats.reset();
+	}
+
+	// the wait policy instance, e.g. for eventfd_wait_policy::fd()
+	WaitPolicy& wait_policy() noexcept {
+		return _wait_policy;
+	}
+
+	// every pull*_wait blocked right now returns false (0 items) once woken.
+	// wakes one waiter per call (all spinning ones with spin_park_wait_policy), call it once per consumer
 	inline void wait_break() {
-		std::lock_guard<std::mutex> lock(*this);
-		std::condition_variable::notify_one();
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		++_pull_break;
+		_wait_policy.notify(*this);
+	}
+
+	// ---------------------------
+	// bounded mode. capacity 0 (default) is unbounded.
+	// every push respects the capacity : the non blocking ones fail, push_back_wait* block.
+	// lowering it below size() keeps the queued items, pushes fail until it drains
+	// ---------------------------
+
+	void set_capacity(size_t capacity) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		_capacity = capacity;
+		if (_push_waiters)
+			_not_full.notify_all();
+	}
+
+	size_t capacity() {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		return _capacity;
+	}
+
+	// on_high(size) runs when size reaches high, on_low(size) when it falls back to low.
+	// both run with the queue locked and must not call into the queue
+	void set_watermarks(size_t high, size_t low, std::function<void(size_t)> on_high, std::function<void(size_t)> on_low) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		_high_watermark = high;
+		_low_watermark = low;
+		_on_high = std::move(on_high);
+		_on_low = std::move(on_low);
+		_above_high = false;
+	}
+
+	// non blocking function. same as push_back / push_back_notify
+	// return false : queue is full
+	inline bool try_push(const T& _Val) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		if (_full()) {
+			_stats.on_push_full();
+			return false;
+		}
+		this->std::deque<T, Alloc>::push_back(_Val);
+		_on_push();
+		return true;
+	}
+
+	inline bool try_push(T&& _Val) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		if (_full()) {
+			_stats.on_push_full();
+			return false;
+		}
+		this->std::deque<T, Alloc>::push_back(std::move(_Val));
+		_on_push();
+		return true;
+	}
+
+	inline bool try_push_notify(const T& _Val) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		if (_full()) {
+			_stats.on_push_full();
+			return false;
+		}
+		this->std::deque<T, Alloc>::push_back(_Val);
+		_on_push();
+		_wait_policy.notify(*this);
+		return true;
+	}
+
+	inline bool try_push_notify(T&& _Val) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		if (_full()) {
+			_stats.on_push_full();
+			return false;
+		}
+		this->std::deque<T, Alloc>::push_back(std::move(_Val));
+		_on_push();
+		_wait_policy.notify(*this);
+		return true;
+	}
+
+	// blocking funtion. wait for free space, push back and notify a consumer
+	// return false : fail to push, woken by push_wait_break
+	inline bool push_back_wait(const T& _Val) {
+		std::unique_lock<std::mutex> lock = _stats.unique_lock(*this);
+		if (!_wait_not_full(lock)) {
+			_stats.on_push_full();
+			return false;
+		}
+		this->std::deque<T, Alloc>::push_back(_Val);
+		_on_push();
+		_wait_policy.notify(*this);
+		return true;
+	}
+
+	inline bool push_back_wait(T&& _Val) {
+		std::unique_lock<std::mutex> lock = _stats.unique_lock(*this);
+		if (!_wait_not_full(lock)) {
+			_stats.on_push_full();
+			return false;
+		}
+		this->std::deque<T, Alloc>::push_back(std::move(_Val));
+		_on_push();
+		_wait_policy.notify(*this);
+		return true;
+	}
+
+	// return false : fail to push, wait timeout or woken by push_wait_break
+	template<class _Rep, class _Period>
+	bool push_back_wait_for(const T& _Val, const std::chrono::duration<_Rep, _Period>& _Rel_time) {
+		std::unique_lock<std::mutex> lock = _stats.unique_lock(*this);
+		if (!_wait_not_full(lock, std::chrono::steady_clock::now() + _Rel_time)) {
+			_stats.on_push_full();
+			return false;
+		}
+		this->std::deque<T, Alloc>::push_back(_Val);
+		_on_push();
+		_wait_policy.notify(*this);
+		return true;
+	}
+
+	template<class _Rep, class _Period>
+	bool push_back_wait_for(T&& _Val, const std::chrono::duration<_Rep, _Period>& _Rel_time) {
+		std::unique_lock<std::mutex> lock = _stats.unique_lock(*this);
+		if (!_wait_not_full(lock, std::chrono::steady_clock::now() + _Rel_time)) {
+			_stats.on_push_full();
+			return false;
+		}
+		this->std::deque<T, Alloc>::push_back(std::move(_Val));
+		_on_push();
+		_wait_policy.notify(*this);
+		return true;
+	}
+
+	// wake every producer blocked in push_back_wait*
+	inline void push_wait_break() {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		++_push_break;
+		_not_full.notify_all();
 	}
+
+private:
+	// caller holds the lock
+	inline bool _full() {
+		return _capacity && this->std::deque<T, Alloc>::size() >= _capacity;
+	}
+
+	// caller holds the lock
+	inline bool _reject_full() {
+		if (!_full())
+			return false;
+		_stats.on_push_full();
+		return true;
+	}
+
+	// caller holds the lock
+	template <class _Iter>
+	inline size_t _push_range(_Iter first, _Iter last) {
+		const size_t before = this->std::deque<T, Alloc>::size();
+		if (_capacity == 0) {
+			this->std::deque<T, Alloc>::insert(this->std::deque<T, Alloc>::end(), first, last);
+		}
+		else {
+			for (; first != last && !_full(); ++first)
+				this->std::deque<T, Alloc>::push_back(*first);
+			if (first != last)
+				_stats.on_push_full();
+		}
+		const size_t count = this->std::deque<T, Alloc>::size() - before;
+		if (count)
+			_on_push(count);
+		return count;
+	}
+
+	// caller holds the lock
+	inline void _on_push(size_t count = 1) {
+		_stats.on_push(count, this->std::deque<T, Alloc>::size());
+		if (_high_watermark && !_above_high && this->std::deque<T, Alloc>::size() >= _high_watermark) {
+			_above_high = true;
+			if (_on_high)
+				_on_high(this->std::deque<T, Alloc>::size());
+		}
+	}
+
+	// caller holds the lock
+	inline void _on_pull(size_t count) {
+		if (count == 0)
+			return;
+		_stats.on_pull(count);
+		if (_push_waiters && !_full()) {
+			if (count == 1)
+				_not_full.notify_one();
+			else
+				_not_full.notify_all();
+		}
+		if (_above_high && this->std::deque<T, Alloc>::size() <= _low_watermark) {
+			_above_high = false;
+			if (_on_low)
+				_on_low(this->std::deque<T, Alloc>::size());
+		}
+	}
+
+	// return false : woken by push_wait_break
+	inline bool _wait_not_full(std::unique_lock<std::mutex>& lock) {
+		const uint64_t gen = _push_break;
+		++_push_waiters;
+		_not_full.wait(lock, [&] { return !_full() || gen != _push_break; });
+		--_push_waiters;
+		return !_full();
+	}
+
+	// return false : wait timeout or woken by push_wait_break
+	template <class _Clock, class _Duration>
+	inline bool _wait_not_full(std::unique_lock<std::mutex>& lock, const std::chrono::time_point<_Clock, _Duration>& deadline) {
+		const uint64_t gen = _push_break;
+		++_push_waiters;
+		_not_full.wait_until(lock, deadline, [&] { return !_full() || gen != _push_break; });
+		--_push_waiters;
+		return !_full();
+	}
+
+	// caller holds the lock
+	inline size_t _pull_all(std::deque<T, Alloc>& out) {
+		const size_t count = this->std::deque<T, Alloc>::size();
+		if (out.empty()) {
+			this->std::deque<T, Alloc>::swap(out);
+		}
+		else {
+			for (auto& v : static_cast<std::deque<T, Alloc>&>(*this))
+				out.push_back(std::move(v));
+			this->std::deque<T, Alloc>::clear();
+		}
+		_on_pull(count);
+		return count;
+	}
+
+	// caller holds the lock
+	template <class _Container>
+	inline size_t _pull_up_to(_Container& out, size_t max_count) {
+		const size_t count = std::min(max_count, this->std::deque<T, Alloc>::size());
+		auto first = this->std::deque<T, Alloc>::begin();
+		auto last = first + count;
+		for (auto it = first; it != last; ++it)
+			out.push_back(std::move(*it));
+		this->std::deque<T, Alloc>::erase(first, last);
+		_on_pull(count);
+		return count;
+	}
+
+	WaitPolicy _wait_policy;
+	StatsPolicy _stats;
+	uint64_t _pull_break{ 0 };	// wait_break generation, guarded by the queue lock
+
+	// bounded mode, guarded by the queue lock
+	std::condition_variable _not_full;
+	size_t _capacity{ 0 };
+	size_t _push_waiters{ 0 };
+	uint64_t _push_break{ 0 };
+	size_t _high_watermark{ 0 };
+	size_t _low_watermark{ 0 };
+	bool _above_high{ false };
+	std::function<void(size_t)> _on_high;
+	std::function<void(size_t)> _on_low;
 };
 
 
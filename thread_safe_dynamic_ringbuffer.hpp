@@ -0,0 +1,328 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __SAFE_DYNAMIC_RINGBUFFER_HPP__
+#define __SAFE_DYNAMIC_RINGBUFFER_HPP__
+
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include "assert.h"
+#include "wait_policy.hpp"
+#include "dynamic_ringbuffer.hpp"
+
+// same interface as safe_ringbuffer<T, _Size>, but the capacity is chosen at runtime.
+// the public condition_variable base is only signalled with cv_wait_policy, use wait_break() to release waiters
+template <class T, class WaitPolicy = cv_wait_policy>
+class safe_dynamic_ringbuffer :
+	protected ring_storage<T>,
+	protected std::mutex,
+	public std::condition_variable
+{
+private:
+	typedef ring_storage<T> _Arr;
+public:
+
+	// capacity is rounded up to a power of two
+	explicit safe_dynamic_ringbuffer(size_t capacity, bool huge_page = false)
+		: _Arr(capacity, huge_page) {}
+
+#if __cplusplus > 201402L && (defined(__GNUC__) ? __GNUC__ > 6 : true)
+	//if you want this code in MSVC, add this C++ Commandline Option [ /Zc:__cplusplus /std:c++17 ]
+	~safe_dynamic_ringbuffer() {
+		if constexpr (std::is_pointer_v<T>) {
+			T del;
+			while (pull_front(del))
+				delete del;
+		}
+	}
+#else
+	~safe_dynamic_ringbuffer() {
+		deallocator();
+	}
+
+private:
+
+	// only pointer template pull_front & delete
+	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	void deallocator() {
+		T del;
+		while (pull_front(del))
+			delete del;
+	}
+
+	// not pointer template. do notting
+	template <class _Ty = T, typename std::enable_if< !std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	void deallocator() {}
+
+public:
+#endif
+
+	// allocates a shared_ptr control block per call. hot paths should use object_pool<T> (object_pool.hpp)
+	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	auto pull_front_auto_recycle() {
+		using T_nptr = typename std::remove_pointer<T>::type;
+		T tmp = nullptr;
+		if (!pull_front(tmp))
+			tmp = new T_nptr;
+		return std::shared_ptr<T_nptr>(tmp, [&](T del){ push_back_force(del); });
+	}
+
+	// return false : buffer is full
+	bool push_back(T& _Val) {
+		std::lock_guard<std::mutex> lock(*this);
+		if (!_full()) {
+			incr_back(_Val);
+			return true;
+		}
+		return false;
+	}
+
+	// return false : buffer is full
+	bool push_back(const T& _Val) {
+		std::lock_guard<std::mutex> lock(*this);
+		if (!_full()) {
+			incr_back(_Val);
+			return true;
+		}
+		return false;
+	}
+
+	void push_back_force(T& _Val) {
+		std::lock_guard<std::mutex> lock(*this);
+		_if_full_delete_once();
+		incr_back(_Val);
+	}
+
+	void push_back_force(const T& _Val) {
+		std::lock_guard<std::mutex> lock(*this);
+		_if_full_delete_once();
+		incr_back(_Val);
+	}
+
+	// return false : buffer is full
+	bool push_back_notify(T& _Val) {
+		std::lock_guard<std::mutex> lock(*this);
+		if (!_full()) {
+			incr_back(_Val);
+			_wait_policy.notify(*this);
+			return true;
+		}
+		return false;
+	}
+
+	// return false : buffer is full
+	bool push_back_notify(const T& _Val) {
+		std::lock_guard<std::mutex> lock(*this);
+		if (!_full()) {
+			incr_back(_Val);
+			_wait_policy.notify(*this);
+			return true;
+		}
+		return false;
+	}
+
+	void push_back_force_notify(T& _Val) {
+		std::lock_guard<std::mutex> lock(*this);
+		_if_full_delete_once();
+		incr_back(_Val);
+		_wait_policy.notify(*this);
+	}
+
+	void push_back_force_notify(const T& _Val) {
+		std::lock_guard<std::mutex> lock(*this);
+		_if_full_delete_once();
+		incr_back(_Val);
+		_wait_policy.notify(*this);
+	}
+
+	// return false : buffer is empty
+	bool pull_front(T& item) {
+		std::lock_guard<std::mutex> lock(*this);
+		if (_empty())
+			return false;
+		item = incr_front();
+		return true;
+	}
+
+	// blocking function
+	// return false : woken by wait_break
+	bool pull_front_wait(T& item) {
+		std::unique_lock<std::mutex> lock(*this);
+		const uint64_t gen = _pull_break;
+		while (_empty())
+		{
+			if (gen != _pull_break)
+				return false;
+			_wait_policy.wait(lock, *this);
+		}
+		item = incr_front();
+		return true;
+	}
+
+	// return false : wait timeout or woken by wait_break
+	template<class _Rep,
+		class _Period>
+	bool pull_front_wait(T& item, const std::chrono::duration<_Rep, _Period>& _Rel_time) {
+		std::unique_lock<std::mutex> lock(*this);
+		const auto deadline = std::chrono::steady_clock::now() + _Rel_time;
+		const uint64_t gen = _pull_break;
+		while (_empty())
+		{
+			const auto now = std::chrono::steady_clock::now();
+			if (gen != _pull_break || now >= deadline)
+				return false;
+			_wait_policy.wait_for(lock, *this, deadline - now);
+		}
+		item = incr_front();
+		return true;
+	}
+
+	// every pull_front_wait blocked right now returns false once woken.
+	// wakes one waiter per call (all spinning ones with spin_park_wait_policy), call it once per consumer
+	void wait_break() {
+		std::lock_guard<std::mutex> lock(*this);
+		++_pull_break;
+		_wait_policy.notify(*this);
+	}
+
+	// zero copy producer side. write in place, then publish with commit()
+	// one reserving producer and one peeking consumer at a time,
+	// and do not mix with push_back_force (it may evict a peeked slot)
+	// return nullptr : buffer is full
+	T* reserve() {
+		std::lock_guard<std::mutex> lock(*this);
+		return _full() ? nullptr : &_Arr::slot(_tail);
+	}
+
+	// return count of contiguous writable slots from ptr (at most n)
+	size_t reserve(T*& ptr, size_t n) {
+		std::lock_guard<std::mutex> lock(*this);
+		ptr = &_Arr::slot(_tail);
+		return std::min({ n, capacity() - (_tail - _head), capacity() - (_tail & _Arr::mask()) });
+	}
+
+	// publish n slots written through reserve()
+	void commit(size_t n = 1) {
+		std::lock_guard<std::mutex> lock(*this);
+		assert(n <= capacity() - (_tail - _head) && "ringbuffer overrun");
+		_tail += n;
+	}
+
+	void commit_notify(size_t n = 1) {
+		std::lock_guard<std::mutex> lock(*this);
+		assert(n <= capacity() - (_tail - _head) && "ringbuffer overrun");
+		_tail += n;
+		_wait_policy.notify(*this);
+	}
+
+	// zero copy consumer side. read in place, then free with release()
+	// return nullptr : buffer is empty
+	T* peek() {
+		std::lock_guard<std::mutex> lock(*this);
+		return _empty() ? nullptr : &_Arr::slot(_head);
+	}
+
+	// return count of contiguous readable slots from ptr (at most n)
+	size_t peek(T*& ptr, size_t n) {
+		std::lock_guard<std::mutex> lock(*this);
+		ptr = &_Arr::slot(_head);
+		return std::min({ n, _tail - _head, capacity() - (_head & _Arr::mask()) });
+	}
+
+	// free n slots read through peek()
+	void release(size_t n = 1) {
+		std::lock_guard<std::mutex> lock(*this);
+		assert(n <= _tail - _head && "ringbuffer underrun");
+		_head += n;
+	}
+
+	auto empty() {
+		std::lock_guard<std::mutex> lock(*this);
+		return _tail == _head;
+	}
+
+	auto full() {
+		std::lock_guard<std::mutex> lock(*this);
+		return _tail - _head == capacity();
+	}
+
+	auto size() noexcept {
+		std::lock_guard<std::mutex> lock(*this);
+		return _tail - _head;
+	}
+
+	void fill(const T& _Val) {
+		std::lock_guard<std::mutex> lock(*this);
+		for (size_t i = 0; i < capacity(); ++i)
+			_Arr::data()[i] = _Val;
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lock(*this);
+		_head = 0;
+		_tail = 0;
+	}
+
+	auto capacity() const noexcept {
+		return _Arr::capacity();
+	}
+
+	// the wait policy instance, e.g. for eventfd_wait_policy::fd()
+	WaitPolicy& wait_policy() noexcept {
+		return _wait_policy;
+	}
+
+private:
+
+	inline bool _full() {
+		return _tail - _head == capacity();
+	}
+
+	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	inline void _if_full_delete_once() {
+		if (_full()) {
+			T dummy = incr_front();
+			delete dummy;
+		}
+	}
+
+	template <class _Ty = T, typename std::enable_if< !std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
+	inline void _if_full_delete_once() {
+		if (_full())
+			T dummy = incr_front();
+	}
+
+	inline bool _empty() {
+		return _tail == _head;
+	}
+
+	void incr_back(const T& _Val) {
+		assert(!_full() && "ringbuffer overrun");
+		_Arr::slot(_tail++) = _Val;
+	};
+
+	void incr_back(T&& _Val) {
+		assert(!_full() && "ringbuffer overrun");
+		_Arr::slot(_tail++) = std::move(_Val);
+	};
+
+	T&& incr_front() {
+		assert(!_empty() && "ringbuffer underrun");
+		return std::move(_Arr::slot(_head++));
+	}
+
+	// free running indices. size is always (_tail - _head)
+	size_t _tail{ 0 };
+	size_t _head{ 0 };
+
+	WaitPolicy _wait_policy;
+	uint64_t _pull_break{ 0 };	// wait_break generation, guarded by the lock
+
+};
+
+#endif // !__SAFE_DYNAMIC_RINGBUFFER_HPP__
@@ -12,9 +12,13 @@
 #include <iterator>
 #include <chrono>
 #include <memory>
+#include <algorithm>
 #include "assert.h"
+#include "wait_policy.hpp"
+#include "container_stats.hpp"
 
-template <class T, size_t _Size>
+// the public condition_variable base is only signalled with cv_wait_policy, use wait_break() to release waiters
+template <class T, size_t _Size, class WaitPolicy = cv_wait_policy, class StatsPolicy = no_stats>
 class safe_ringbuffer :
 	protected std::array<T, _Size>,
 	protected std::mutex,
@@ -55,6 +59,7 @@ private:
 public:
 #endif
 
+	// allocates a shared_ptr control block per call. hot paths should use object_pool<T> (object_pool.hpp)
 	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
 	auto pull_front_auto_recycle() {
 		using T_nptr = typename std::remove_pointer<T>::type;
@@ -66,130 +71,203 @@ public:
 
 	// return false : buffer is full
 	bool push_back(T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		if (!_full()) {
 			incr_back(_Val);
 			return true;
 		}
+		_stats.on_push_full();
 		return false;
 	}
 
 	// return false : buffer is full
 	bool push_back(const T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		if (!_full()) {
 			incr_back(_Val);
 			return true;
 		}
+		_stats.on_push_full();
 		return false;
 	}
 
 	void push_back_force(T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		_if_full_delete_once();
 		incr_back(_Val);
 	}
 
 	void push_back_force(const T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		_if_full_delete_once();
 		incr_back(_Val);
 	}
 
 	// return false : buffer is full
 	bool push_back_notify(T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		if (!_full()) {
 			incr_back(_Val);
-			notify_one();
+			_wait_policy.notify(*this);
 			return true;
 		}
+		_stats.on_push_full();
 		return false;
 	}
 
 	// return false : buffer is full
 	bool push_back_notify(const T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		if (!_full()) {
 			incr_back(_Val);
-			notify_one();
+			_wait_policy.notify(*this);
 			return true;
 		}
+		_stats.on_push_full();
 		return false;
 	}
 
 	void push_back_force_notify(T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		_if_full_delete_once();
 		incr_back(_Val);
-		notify_one();
+		_wait_policy.notify(*this);
 	}
 
 	void push_back_force_notify(const T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		_if_full_delete_once();
 		incr_back(_Val);
-		notify_one();
+		_wait_policy.notify(*this);
 	}
 
 	// return false : buffer is empty
 	bool pull_front(T& item) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		if (_empty())
 			return false;
 		item = incr_front();
 		return true;
 	}
 
-	// return false : buffer is empty
+	// blocking function
+	// return false : woken by wait_break
 	bool pull_front_wait(T& item) {
-		std::unique_lock<std::mutex> lock(*this);
+		std::unique_lock<std::mutex> lock = _stats.unique_lock(*this);
+		const uint64_t gen = _pull_break;
 		while (_empty())
 		{
-			wait(lock);
-			if (_empty())
+			if (gen != _pull_break)
 				return false;
+			_wait_policy.wait(lock, *this);
+			if (_empty())
+				_stats.on_empty_wakeup();
 		}
 		item = incr_front();
 		return true;
 	}
 
-	// return false : buffer is empty or wait timeout
+	// return false : wait timeout or woken by wait_break
 	template<class _Rep,
 		class _Period>
 	bool pull_front_wait(T& item, const std::chrono::duration<_Rep, _Period>& _Rel_time) {
-		std::unique_lock<std::mutex> lock(*this);
-		if (_empty()) {
-			wait_for(lock, _Rel_time);
-			if (_empty())
+		std::unique_lock<std::mutex> lock = _stats.unique_lock(*this);
+		const auto deadline = std::chrono::steady_clock::now() + _Rel_time;
+		const uint64_t gen = _pull_break;
+		while (_empty())
+		{
+			const auto now = std::chrono::steady_clock::now();
+			if (gen != _pull_break || now >= deadline)
 				return false;
+			_wait_policy.wait_for(lock, *this, deadline - now);
+			if (_empty())
+				_stats.on_empty_wakeup();
 		}
 		item = incr_front();
 		return true;
 	}
 
+	// every pull_front_wait blocked right now returns false once woken.
+	// wakes one waiter per call (all spinning ones with spin_park_wait_policy), call it once per consumer
+	void wait_break() {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		++_pull_break;
+		_wait_policy.notify(*this);
+	}
+
+	// zero copy producer side. write in place, then publish with commit()
+	// one reserving producer and one peeking consumer at a time,
+	// and do not mix with push_back_force (it may evict a peeked slot)
+	// return nullptr : buffer is full
+	T* reserve() {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		return _full() ? nullptr : &*back_it;
+	}
+
+	// return count of contiguous writable slots from ptr (at most n)
+	size_t reserve(T*& ptr, size_t n) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		ptr = &*back_it;
+		return std::min({ n, capacity() - _size, (size_t)(_Arr::end() - back_it) });
+	}
+
+	// publish n slots written through reserve()
+	void commit(size_t n = 1) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		incr_back_n(n);
+	}
+
+	void commit_notify(size_t n = 1) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		incr_back_n(n);
+		_wait_policy.notify(*this);
+	}
+
+	// zero copy consumer side. read in place, then free with release()
+	// return nullptr : buffer is empty
+	T* peek() {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		return _empty() ? nullptr : &*front_it;
+	}
+
+	// return count of contiguous readable slots from ptr (at most n)
+	size_t peek(T*& ptr, size_t n) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		ptr = &*front_it;
+		return std::min({ n, _size, (size_t)(_Arr::end() - front_it) });
+	}
+
+	// free n slots read through peek()
+	void release(size_t n = 1) {
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
+		assert(n <= _size && "ringbuffer underrun");
+		_size -= n;
+		_stats.on_pull(n);
+		front_it = _Arr::begin() + (front_it - _Arr::begin() + n) % _Size;
+	}
+
 	auto empty() {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		return _size == 0;
 	}
 
 	auto full() {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		return _size == capacity();
 	}
 
 	auto size() noexcept {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		return _size;
 	}
 
 	void fill(const T& _Val) {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		_Arr::fill(_Val);
 	}
 
 	void clear() {
-		std::lock_guard<std::mutex> lock(*this);
+		stats_lock_guard<StatsPolicy> lock(*this, _stats);
 		back_it = _Arr::begin();
 		front_it = _Arr::begin();
 		_size = 0;
@@ -199,6 +277,20 @@ public:
 		return _Size;
 	}
 
+	// the wait policy instance, e.g. for eventfd_wait_policy::fd()
+	WaitPolicy& wait_policy() noexcept {
+		return _wait_policy;
+	}
+
+	// all zero with no_stats
+	container_stats stats() const {
+		return _stats.snapshot();
+	}
+
+	void reset_stats() {
+		_stats.reset();
+	}
+
 private:
 
 	inline bool _full() {
@@ -208,6 +300,7 @@ private:
 	template <class _Ty = T, typename std::enable_if<std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
 	inline void _if_full_delete_once() {
 		if (_full()) {
+			_stats.on_evict();
 			T dummy = incr_front();
 			delete dummy;
 		}
@@ -215,8 +308,10 @@ private:
 
 	template <class _Ty = T, typename std::enable_if< !std::is_pointer<_Ty>::value, _Ty>::type* = nullptr>
 	inline void _if_full_delete_once() {
-		if (_full())
+		if (_full()) {
+			_stats.on_evict();
 			T dummy = incr_front();
+		}
 	}
 
 	inline bool _empty() {
@@ -226,6 +321,7 @@ private:
 	void incr_back(const T& _Val) {
 		assert(!_full() && "ringbuffer overrun");
 		++_size;
+		_stats.on_push(1, _size);
 		*back_it = std::move(_Val);
 		if (++back_it == _Arr::end())
 			back_it = _Arr::begin();
@@ -234,14 +330,23 @@ private:
 	void incr_back(T&& _Val) {
 		assert(!_full() && "ringbuffer overrun");
 		++_size;
+		_stats.on_push(1, _size);
 		*back_it = std::move(_Val);
 		if (++back_it == _Arr::end())
 			back_it = _Arr::begin();
 	};
 
+	void incr_back_n(size_t n) {
+		assert(n <= capacity() - _size && "ringbuffer overrun");
+		_size += n;
+		_stats.on_push(n, _size);
+		back_it = _Arr::begin() + (back_it - _Arr::begin() + n) % _Size;
+	}
+
 	T&& incr_front() {
 		assert(!_empty() && "ringbuffer underrun");
 		--_size;
+		_stats.on_pull(1);
 		auto before_it = front_it++;
 		if (front_it == _Arr::end())
 			front_it = _Arr::begin();
@@ -253,6 +358,9 @@ private:
 
 	size_t _size{ 0 };
 
+	WaitPolicy _wait_policy;
+	uint64_t _pull_break{ 0 };	// wait_break generation, guarded by the lock
+	StatsPolicy _stats;
 };
 
 #endif // !__SAFE_RINGBUFFER_HPP_
@@ -0,0 +1,296 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __WAIT_POLICY_HPP__
+#define __WAIT_POLICY_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <system_error>
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+// pause hint for busy wait loops
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	_mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+// eventcount : lets a waiter sleep on "something changed" without a lock.
+//	waiter   : key = prepare_wait(); re-check condition; cancel_wait() or wait(key)
+//	notifier : make condition true; notify_one()
+// notify is a fence and a load when nobody is registered, and skips the syscall while waiters only spin
+class eventcount
+{
+public:
+	eventcount() = default;
+	eventcount(const eventcount&) = delete;
+	eventcount& operator= (const eventcount&) = delete;
+
+	uint32_t prepare_wait() noexcept {
+		_waiters.fetch_add(1, std::memory_order_seq_cst);
+		return _epoch.load(std::memory_order_seq_cst);
+	}
+
+	void cancel_wait() noexcept {
+		_waiters.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	// spin, then yield, then park until notified after prepare_wait()
+	template <unsigned spin_count = 0, unsigned yield_count = 0>
+	void wait(uint32_t key) noexcept {
+		if (!spin_then_yield<spin_count, yield_count>(key)) {
+			_sleepers.fetch_add(1, std::memory_order_seq_cst);
+			while (_epoch.load(std::memory_order_seq_cst) == key)
+				park(key, nullptr);
+			_sleepers.fetch_sub(1, std::memory_order_relaxed);
+		}
+		_waiters.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	// return false : timeout
+	template <unsigned spin_count = 0, unsigned yield_count = 0, class _Rep, class _Period>
+	bool wait_for(uint32_t key, const std::chrono::duration<_Rep, _Period>& _Rel_time) noexcept {
+		const auto deadline = std::chrono::steady_clock::now() + _Rel_time;
+		bool notified = spin_then_yield<spin_count, yield_count>(key);
+		if (!notified) {
+			_sleepers.fetch_add(1, std::memory_order_seq_cst);
+			for (;;) {
+				if (_epoch.load(std::memory_order_seq_cst) != key) {
+					notified = true;
+					break;
+				}
+				const auto now = std::chrono::steady_clock::now();
+				if (now >= deadline)
+					break;
+				const auto rest = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now);
+				park(key, &rest);
+			}
+			_sleepers.fetch_sub(1, std::memory_order_relaxed);
+		}
+		_waiters.fetch_sub(1, std::memory_order_relaxed);
+		return notified;
+	}
+
+	void notify_one() noexcept {
+		notify(false);
+	}
+
+	void notify_all() noexcept {
+		notify(true);
+	}
+
+private:
+	template <unsigned spin_count, unsigned yield_count>
+	bool spin_then_yield(uint32_t key) noexcept {
+		for (unsigned i = 0; i < spin_count; ++i) {
+			if (_epoch.load(std::memory_order_acquire) != key)
+				return true;
+			cpu_relax();
+		}
+		for (unsigned i = 0; i < yield_count; ++i) {
+			if (_epoch.load(std::memory_order_acquire) != key)
+				return true;
+			std::this_thread::yield();
+		}
+		return false;
+	}
+
+	void notify(bool all) noexcept {
+		// pairs with the seq_cst increment in prepare_wait (store -> load ordering)
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (_waiters.load(std::memory_order_seq_cst) == 0)
+			return;
+		_epoch.fetch_add(1, std::memory_order_seq_cst);
+		if (_sleepers.load(std::memory_order_seq_cst) == 0)
+			return;
+#ifdef __linux__
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_epoch), FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, nullptr, nullptr, 0);
+#else
+		{ std::lock_guard<std::mutex> lock(_park_mutex); }
+		if (all)
+			_park_cv.notify_all();
+		else
+			_park_cv.notify_one();
+#endif
+	}
+
+	void park(uint32_t key, const std::chrono::nanoseconds* rel_time) noexcept {
+#ifdef __linux__
+		struct timespec ts;
+		if (rel_time) {
+			ts.tv_sec = (time_t)(rel_time->count() / 1000000000);
+			ts.tv_nsec = (long)(rel_time->count() % 1000000000);
+		}
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_epoch), FUTEX_WAIT_PRIVATE, key, rel_time ? &ts : nullptr, nullptr, 0);
+#else
+		std::unique_lock<std::mutex> lock(_park_mutex);
+		if (_epoch.load(std::memory_order_seq_cst) != key)
+			return;
+		if (rel_time)
+			_park_cv.wait_for(lock, *rel_time);
+		else
+			_park_cv.wait(lock);
+#endif
+	}
+
+	static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bit");
+
+	std::atomic<uint32_t> _epoch{ 0 };
+	std::atomic<uint32_t> _waiters{ 0 };
+	std::atomic<uint32_t> _sleepers{ 0 };
+#ifndef __linux__
+	std::mutex _park_mutex;
+	std::condition_variable _park_cv;
+#endif
+};
+
+//--------------------------------------------------------------------------------------------------
+// Wait policies for safe_deque / safe_ringbuffer
+//	notify   : called by producers with the queue lock held
+//	wait     : called by consumers with the queue lock held and the queue empty.
+//	           returns after one wake up (or spuriously); the caller re-checks the queue
+//--------------------------------------------------------------------------------------------------
+
+// default. park on the queue's own condition_variable
+struct cv_wait_policy
+{
+	inline void notify(std::condition_variable& cv) {
+		cv.notify_one();
+	}
+
+	inline void wait(std::unique_lock<std::mutex>& lock, std::condition_variable& cv) {
+		cv.wait(lock);
+	}
+
+	template<class _Rep, class _Period>
+	inline void wait_for(std::unique_lock<std::mutex>& lock, std::condition_variable& cv,
+		const std::chrono::duration<_Rep, _Period>& _Rel_time) {
+		cv.wait_for(lock, _Rel_time);
+	}
+};
+
+// low latency. spin, then yield, then park on a futex eventcount.
+// producers skip the wake entirely while no consumer is waiting
+template <unsigned spin_count = 2048, unsigned yield_count = 64>
+struct spin_park_wait_policy
+{
+	inline void notify(std::condition_variable&) {
+		_ec.notify_one();
+	}
+
+	inline void wait(std::unique_lock<std::mutex>& lock, std::condition_variable&) {
+		const uint32_t key = _ec.prepare_wait();
+		lock.unlock();
+		_ec.template wait<spin_count, yield_count>(key);
+		lock.lock();
+	}
+
+	template<class _Rep, class _Period>
+	inline void wait_for(std::unique_lock<std::mutex>& lock, std::condition_variable&,
+		const std::chrono::duration<_Rep, _Period>& _Rel_time) {
+		const uint32_t key = _ec.prepare_wait();
+		lock.unlock();
+		_ec.template wait_for<spin_count, yield_count>(key, _Rel_time);
+		lock.lock();
+	}
+
+	eventcount _ec;
+};
+
+#ifdef __linux__
+// epoll integration. the queue signals an eventfd that an event loop can poll next to its sockets.
+// the fd is written once per signal / ack cycle, i.e. when the queue goes from drained to non empty:
+//	epoll_ctl(ep, EPOLL_CTL_ADD, q.wait_policy().fd(), ...);	// EPOLLIN
+//	on readable : q.wait_policy().ack(); while (q.pull_front(v)) ...;	// ack first, then drain
+// pull_front_wait still works (it polls the fd with the queue unlocked)
+struct eventfd_wait_policy
+{
+	eventfd_wait_policy() : _fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+		if (_fd < 0)
+			throw std::system_error(errno, std::generic_category(), "eventfd");
+	}
+
+	~eventfd_wait_policy() {
+		close(_fd);
+	}
+
+	eventfd_wait_policy(const eventfd_wait_policy&) = delete;
+	eventfd_wait_policy& operator= (const eventfd_wait_policy&) = delete;
+
+	int fd() const noexcept {
+		return _fd;
+	}
+
+	// clear the fd and re-arm. items pushed after this signal again
+	void ack() noexcept {
+		uint64_t value;
+		ssize_t ret = read(_fd, &value, sizeof(value));
+		(void)ret;
+		_signaled.store(false, std::memory_order_release);
+	}
+
+	inline void notify(std::condition_variable&) {
+		if (!_signaled.exchange(true, std::memory_order_acq_rel)) {
+			const uint64_t one = 1;
+			ssize_t ret = write(_fd, &one, sizeof(one));
+			(void)ret;
+		}
+	}
+
+	// called with the queue locked and empty, so ack here loses no signal
+	inline void wait(std::unique_lock<std::mutex>& lock, std::condition_variable&) {
+		ack();
+		lock.unlock();
+		poll_fd(-1);
+		lock.lock();
+	}
+
+	template<class _Rep, class _Period>
+	inline void wait_for(std::unique_lock<std::mutex>& lock, std::condition_variable&,
+		const std::chrono::duration<_Rep, _Period>& _Rel_time) {
+		// round up, a remainder under 1ms must not become poll(0) and spin
+		// (std::chrono::ceil is C++17)
+		auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(_Rel_time).count();
+		if (std::chrono::milliseconds(ms) < _Rel_time)
+			++ms;
+		ack();
+		lock.unlock();
+		poll_fd(ms > INT_MAX ? INT_MAX : ms < 0 ? 0 : (int)ms);
+		lock.lock();
+	}
+
+private:
+	void poll_fd(int timeout_ms) noexcept {
+		struct pollfd pfd;
+		pfd.fd = _fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		while (poll(&pfd, 1, timeout_ms) < 0 && errno == EINTR) {}
+	}
+
+	int _fd;
+	std::atomic<bool> _signaled{ false };
+};
+#endif
+
+#endif // !__WAIT_POLICY_HPP__
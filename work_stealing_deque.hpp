@@ -0,0 +1,143 @@
+// revision 1.0 by luj
+// for cross platform
+
+#pragma once
+#ifndef __WORK_STEALING_DEQUE_HPP__
+#define __WORK_STEALING_DEQUE_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Chase-Lev work stealing deque (Le et al. C11 memory model version).
+// the owner thread pushes and pulls at the back without locks,
+// any other thread steals from the front with a single CAS.
+// the circular array doubles when full. retired arrays are kept until destruction
+// because a thief may still be reading them.
+// T is copied through std::atomic<T>, so store pointers / indices / small handles
+template <class T>
+class work_stealing_deque
+{
+	static_assert(std::is_trivially_copyable<T>::value, "work_stealing_deque requires trivially copyable T");
+
+	struct array {
+		explicit array(size_t cap) : capacity(cap), mask(cap - 1), slots(new std::atomic<T>[cap]) {}
+		~array() { delete[] slots; }
+
+		inline T get(int64_t i) const noexcept {
+			return slots[(size_t)i & mask].load(std::memory_order_relaxed);
+		}
+
+		inline void put(int64_t i, T v) noexcept {
+			slots[(size_t)i & mask].store(v, std::memory_order_relaxed);
+		}
+
+		const size_t capacity;
+		const size_t mask;
+		std::atomic<T>* slots;
+	};
+
+public:
+	// capacity is rounded up to a power of two
+	explicit work_stealing_deque(size_t capacity = 256) {
+		size_t cap = 2;
+		while (cap < capacity)
+			cap <<= 1;
+		_arrays.push_back(new array(cap));
+		_array.store(_arrays.back(), std::memory_order_relaxed);
+	}
+
+	~work_stealing_deque() {
+		for (auto a : _arrays)
+			delete a;
+	}
+
+	work_stealing_deque(const work_stealing_deque&) = delete;
+	work_stealing_deque& operator= (const work_stealing_deque&) = delete;
+
+	// ---------------------------
+	// owner thread only
+	// ---------------------------
+
+	void push_back(T _Val) {
+		const int64_t b = _bottom.load(std::memory_order_relaxed);
+		const int64_t t = _top.load(std::memory_order_acquire);
+		array* a = _array.load(std::memory_order_relaxed);
+		if (b - t > (int64_t)a->capacity - 1)
+			a = grow(a, t, b);
+		a->put(b, _Val);
+		_bottom.store(b + 1, std::memory_order_release);
+	}
+
+	// return false : deque is empty (or the last item was stolen)
+	bool pull_back(T& item) {
+		const int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+		array* a = _array.load(std::memory_order_relaxed);
+		_bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = _top.load(std::memory_order_relaxed);
+		if (t > b) {
+			_bottom.store(b + 1, std::memory_order_relaxed);
+			return false;
+		}
+		item = a->get(b);
+		if (t == b) {
+			// last item, race the thieves for it
+			const bool won = _top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			_bottom.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+		return true;
+	}
+
+	// ---------------------------
+	// any thread
+	// ---------------------------
+
+	// return false : deque is empty or lost the race to another thief / the owner
+	bool steal(T& item) {
+		int64_t t = _top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b = _bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return false;
+		array* a = _array.load(std::memory_order_acquire);
+		item = a->get(t);
+		return _top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	}
+
+	// snapshot, may be stale by the time it returns
+	bool empty() const noexcept {
+		return size() == 0;
+	}
+
+	size_t size() const noexcept {
+		const int64_t b = _bottom.load(std::memory_order_relaxed);
+		const int64_t t = _top.load(std::memory_order_relaxed);
+		return b > t ? (size_t)(b - t) : 0;
+	}
+
+	size_t capacity() const noexcept {
+		return _array.load(std::memory_order_relaxed)->capacity;
+	}
+
+private:
+	// owner only
+	array* grow(array* a, int64_t t, int64_t b) {
+		array* bigger = new array(a->capacity * 2);
+		for (int64_t i = t; i < b; ++i)
+			bigger->put(i, a->get(i));
+		_arrays.push_back(bigger);
+		_array.store(bigger, std::memory_order_release);
+		return bigger;
+	}
+
+	alignas(64) std::atomic<int64_t> _top{ 0 };		// thieves
+	alignas(64) std::atomic<int64_t> _bottom{ 0 };	// owner
+	alignas(64) std::atomic<array*> _array{ nullptr };
+	std::vector<array*> _arrays;					// owner only
+};
+
+#endif // !__WORK_STEALING_DEQUE_HPP__